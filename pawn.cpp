@@ -3,17 +3,65 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <memory>
 #include <filesystem>
 #include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <iterator>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #define NULL_FLOAT_VECTOR std::vector <float>({ -2598445.9842f })
 const float PI = acos(-1);
 
+#ifdef PAWN_COUNT_ALLOCATIONS
+/* Counts every operator new so --self-test can verify that steady-state frames do not allocate.
+   Kept out of line, otherwise GCC sees malloc paired with operator delete and warns at every new expression */
+#ifdef _MSC_VER
+#define PAWN_NOINLINE __declspec(noinline)
+#else
+#define PAWN_NOINLINE __attribute__((noinline))
+#endif
+std::atomic <unsigned long long> heap_allocations{ 0 };
+PAWN_NOINLINE void* operator new(std::size_t size)
+{
+    ++heap_allocations;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) { return p; }
+    throw std::bad_alloc();
+}
+PAWN_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+PAWN_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
 struct ShaderProgramInfo
 {
     std::string vertexShaderProgramInfo;
@@ -27,42 +75,65 @@ std::string shader_path(char** argv, std::string path)
     std::string shader_path = exe_path + path;
     return shader_path;
 }
+/* FNV-1a, for cache file names and content hashes. Pass a previous result as hash to continue it */
+std::uint64_t fnv1a(const void* data, std::size_t size, std::uint64_t hash = 14695981039346656037ull)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ static_cast <const unsigned char*>(data)[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Reads the file in one go and splits it at its "#shader vertex" / "#shader fragment" lines */
 ShaderProgramInfo parseShader(const std::string& filepath)
 {
-    std::ifstream stream(filepath);
+    std::ifstream stream(filepath, std::ios::binary);
+    std::string text((std::istreambuf_iterator <char>(stream)), std::istreambuf_iterator <char>());
 
     enum class ShaderType
     {
         NONE = -1, VERTEX = 0, FRAGMENT = 1
     };
 
-    std::stringstream ss[2];
-    std::string line;
+    std::string sources[2];
     ShaderType type = ShaderType::NONE;
-
-    while (getline(stream, line))
+    for (std::size_t begin = 0; begin < text.size();)
     {
-        if (line.find("#shader") != std::string::npos)
+        std::size_t end = text.find('\n', begin);
+        end = end == std::string::npos ? text.size() : end;
+        const char* line = text.data() + begin;
+        const char* line_end = text.data() + (end > begin && text[end - 1] == '\r' ? end - 1 : end);
+        auto contains = [line, line_end](const char* word) { return std::search(line, line_end, word, word + std::strlen(word)) != line_end; };
+        if (contains("#shader"))
         {
-            if (line.find("vertex") != std::string::npos)
-            {
-                type = ShaderType::VERTEX;
-            }
-            if (line.find("fragment") != std::string::npos)
-            {
-                type = ShaderType::FRAGMENT;
-            }
+            if (contains("vertex")) { type = ShaderType::VERTEX; }
+            if (contains("fragment")) { type = ShaderType::FRAGMENT; }
         }
-        else
+        else if (type != ShaderType::NONE)
         {
-            if (type != ShaderType::NONE)
-            {
-                ss[static_cast <int>(type)] << line << '\n';
-            }
+            sources[static_cast <int>(type)].append(line, line_end).push_back('\n');
         }
+        begin = end + 1;
     }
-    return { ss[0].str(), ss[1].str() };
+    return { sources[0], sources[1] };
 }
+
+/* Same vertex stage with a fragment stage that writes nothing, for depth-only passes */
+ShaderProgramInfo depth_only(const ShaderProgramInfo& source)
+{
+    return { source.vertexShaderProgramInfo, "#version 330 core\n\nvoid main() {}\n" };
+}
+
+/* Wall time of the last build, compile includes both stages */
+struct ShaderTimings
+{
+    double compile_ms = 0.0;
+    double link_ms = 0.0;
+    double binary_ms = 0.0;
+    bool from_binary = false;
+};
+
 unsigned int compileShader(unsigned int type, const std::string& source)
 {
     unsigned int id = glCreateShader(type);
@@ -76,9 +147,10 @@ unsigned int compileShader(unsigned int type, const std::string& source)
     /* If shader is not compiled correctly */
     if (result == GL_FALSE)
     {
-        int length;
+        int length = 0;
         glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
-        std::unique_ptr <char[]> message = std::make_unique <char[]>(length);
+        std::unique_ptr <char[]> message = std::make_unique <char[]>(std::max(length, 1));
+        message[0] = '\0';
         if (type == GL_VERTEX_SHADER)
         {
             std::cout << "Failed to compile GL_VERTEX_SHADER!" << std::endl;
@@ -87,492 +159,5554 @@ unsigned int compileShader(unsigned int type, const std::string& source)
         {
             std::cout << "Failed to compile GL_FRAGMENT_SHADER!" << std::endl;
         }
-        glGetShaderInfoLog(id, length, &length, message.get());
-        std::cout << *message.get() << std::endl;
+        glGetShaderInfoLog(id, std::max(length, 1), nullptr, message.get());
+        std::cout << message.get() << std::endl;
         glDeleteShader(id);
         return 0;
     }
 
     return id;
 }
-unsigned int createShader(const std::string& vertexShader, const std::string& fragmentShader)
+/* Returns 0 when a stage fails to compile or the program fails to link, after printing the log.
+   retrievable asks the driver to keep the binary for glGetProgramBinary */
+unsigned int createShader(const std::string& vertexShader, const std::string& fragmentShader, ShaderTimings* timings = nullptr, 
+    bool retrievable = false)
 {
-    unsigned int program = glCreateProgram();
+    auto start = std::chrono::steady_clock::now();
     unsigned int vs = compileShader(GL_VERTEX_SHADER, vertexShader);
     unsigned int fs = compileShader(GL_FRAGMENT_SHADER, fragmentShader);
+    auto compiled = std::chrono::steady_clock::now();
+    if (vs == 0 || fs == 0)
+    {
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return 0;
+    }
 
+    unsigned int program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    if (retrievable) { glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); }
     /* Link to the program */
     glLinkProgram(program);
-    glValidateProgram(program);
 
     /* Since shaders are attached to the program, we can delete shaders */
+    glDetachShader(program, vs);
+    glDetachShader(program, fs);
     glDeleteShader(vs);
     glDeleteShader(fs);
 
+    int result;
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    if (timings)
+    {
+        timings->compile_ms = std::chrono::duration <double, std::milli>(compiled - start).count();
+        timings->link_ms = std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - compiled).count();
+        timings->binary_ms = 0.0;
+        timings->from_binary = false;
+    }
+    if (result == GL_FALSE)
+    {
+        int length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::unique_ptr <char[]> message = std::make_unique <char[]>(std::max(length, 1));
+        message[0] = '\0';
+        glGetProgramInfoLog(program, std::max(length, 1), nullptr, message.get());
+        std::cout << "Failed to link shader program!" << std::endl << message.get() << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+
     return program;
 }
 
-class Rotatable
+/* Counts GL calls made on the per-frame path, so redundant state changes show up in the frame statistics */
+#define GL_COUNTED(call) (GLState::count(), call)
+
+/* Tracks bound GL objects so redundant glUseProgram / glBindVertexArray calls are skipped */
+class GLState
 {
 private:
-    glm::mat4 transform;
-    glm::vec3 pivot;
-    unsigned int matloc = 0;
+    static inline unsigned int program = 0;
+    static inline unsigned int vao = 0;
+    static inline unsigned int uniform_buffer = 0;
+    static inline std::size_t uniform_offset = 0;
+    static inline unsigned long long calls = 0;
+    static inline unsigned long long draw_calls = 0;
+    static inline unsigned long long triangles = 0;
+    static inline unsigned long long frame = 0;
+    /* -1 until first set, the GL default is unknown after raw calls */
+    static inline int face_culling = -1;
+    static inline GLenum front_face = 0;
+    /* 0 until first read or set */
+    static inline GLenum depth_func = 0;
 public:
-    Rotatable() : pivot(glm::vec3(0.3f, 0.3f, 0.3f)), transform(glm::mat4(1)) {}
-    Rotatable(glm::vec3 pivot) : pivot(pivot), transform(glm::mat4(1)) {}
-
-    glm::mat4 get_transform() { return transform; }
-    glm::vec3 get_pivot() { return pivot; }
-    void set_pivot(glm::vec3 pivot) { this->pivot = pivot; }
-
-    void init_rotation(unsigned int& shader)
+    static void count(unsigned long long n = 1) { calls += n; }
+    static void count_draw(unsigned long long drawn_triangles)
     {
-        this->matloc = glGetUniformLocation(shader, "transform");
-        glUniformMatrix4fv(matloc, 1, GL_FALSE, glm::value_ptr<float>(transform));
-        glUseProgram(shader);
+        ++draw_calls;
+        triangles += drawn_triangles;
     }
-    virtual void apply_rotation(unsigned int& shader)
+    static unsigned long long get_calls() { return calls; }
+    static unsigned long long get_draw_calls() { return draw_calls; }
+    static unsigned long long get_triangles() { return triangles; }
+    /* Number of reset_frame_stats() calls, lets per-frame work on shared resources run once per frame */
+    static unsigned long long get_frame() { return frame; }
+    static void reset_frame_stats()
     {
-        transform = glm::rotate(transform, 0.001f, pivot);
-        glUniformMatrix4fv(matloc, 1, GL_FALSE, glm::value_ptr<float>(transform));
-        glUseProgram(shader);
+        ++frame;
+        calls = 0;
+        draw_calls = 0;
+        triangles = 0;
     }
 
-    virtual void random_pure_virtual_function() = 0;
-    virtual ~Rotatable() {};
+    static void use_program(unsigned int id)
+    {
+        if (program == id) { return; }
+        GL_COUNTED(glUseProgram(id));
+        program = id;
+    }
+    static void bind_vertex_array(unsigned int id)
+    {
+        if (vao == id) { return; }
+        GL_COUNTED(glBindVertexArray(id));
+        vao = id;
+    }
+    /* Only one indexed binding point is in use (the Transforms block), so a single range is tracked */
+    static void bind_uniform_buffer_range(unsigned int binding, unsigned int buffer, std::size_t offset, std::size_t size)
+    {
+        if (uniform_buffer == buffer && uniform_offset == offset) { return; }
+        GL_COUNTED(glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size));
+        uniform_buffer = buffer;
+        uniform_offset = offset;
+    }
+    /* Deleting a bound object unbinds it, and GL may hand its name out again */
+    static void forget_uniform_buffer(unsigned int id) { if (uniform_buffer == id) { uniform_buffer = 0; } }
+    static void forget_program(unsigned int id) { if (program == id) { program = 0; } }
+    static void forget_vertex_array(unsigned int id) { if (vao == id) { vao = 0; } }
+    /* front is only applied while culling is on */
+    static void set_face_culling(bool enabled, GLenum front)
+    {
+        if (face_culling != static_cast <int>(enabled))
+        {
+            if (enabled) { GL_COUNTED(glEnable(GL_CULL_FACE)); }
+            else { GL_COUNTED(glDisable(GL_CULL_FACE)); }
+            face_culling = enabled;
+        }
+        if (enabled && front_face != front)
+        {
+            GL_COUNTED(glFrontFace(front));
+            front_face = front;
+        }
+    }
+    static GLenum get_depth_func()
+    {
+        if (depth_func == 0)
+        {
+            GLint current = GL_LESS;
+            GL_COUNTED(glGetIntegerv(GL_DEPTH_FUNC, &current));
+            depth_func = static_cast <GLenum>(current);
+        }
+        return depth_func;
+    }
+    static void set_depth_func(GLenum func)
+    {
+        if (depth_func == func) { return; }
+        GL_COUNTED(glDepthFunc(func));
+        depth_func = func;
+    }
+    /* Must be called after any raw glUseProgram / glBindVertexArray / glEnable(GL_CULL_FACE) / glDepthFunc outside this class */
+    static void invalidate()
+    {
+        program = 0;
+        vao = 0;
+        uniform_buffer = 0;
+        face_culling = -1;
+        front_face = 0;
+        depth_func = 0;
+    }
 };
 
-class Object3D
+double percentile(std::vector <double> samples, double fraction)
 {
-private:
-    std::vector <float> positions;
-    std::vector <float> colors;
-    std::vector <float> normals;
-    unsigned int vbo = 0, cbo = 0, nbo = 0;
+    if (samples.empty()) { return 0.0; }
+    std::size_t index = static_cast <std::size_t>(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
 
-    const unsigned int DIMENSIONS = 3;
+#ifdef PAWN_PROFILE
+/* Scoped CPU timers and GL timestamp queries. Events stay in fixed-size rings, one per thread, so the last frames
+   before a spike can still be exported as a Chrome trace (chrome://tracing, Perfetto) afterwards, and every frame
+   adds the time spent per scope name to a histogram of recent frames. Build with -DPAWN_PROFILE, without it the
+   PAWN_*_SCOPE macros compile to nothing */
+class Profiler
+{
 public:
-    Object3D() = default;
-    Object3D(const Object3D& other)
-    {
-        if (other.is_vbo_init()) { this->init_vbo(other.positions); }
-        if (other.is_cbo_init()) { this->init_cbo(other.colors); }
-        if (other.is_nbo_init()) { this->init_nbo(other.normals); }
-    }
-    Object3D& operator =(const Object3D& other) 
-    {
-        if (other.is_vbo_init()) { this->init_vbo(other.positions); }
-        if (other.is_cbo_init()) { this->init_cbo(other.colors); }
-        if (other.is_nbo_init()) { this->init_nbo(other.normals); }
+    /* Events kept per thread, older ones are overwritten */
+    static constexpr std::size_t THREAD_EVENTS = 1 << 16;
+    /* Timestamp query pairs in flight. GL scopes beyond this are dropped and counted */
+    static constexpr std::size_t GPU_QUERIES = 1 << 14;
+    /* Frames a query result is given before it is read, so reading never stalls the pipeline */
+    static constexpr unsigned long long QUERY_LATENCY = 4;
+    /* Frames each histogram remembers */
+    static constexpr std::size_t HISTORY_FRAMES = 1024;
 
-        return *this;
+    struct Event
+    {
+        const char* name = nullptr;
+        /* Microseconds since the profiler was created */
+        double begin = 0.0;
+        double duration = 0.0;
+        unsigned long long frame = 0;
     };
 
-    std::vector <float> get_positions() const { return positions; }
-    std::vector <float> get_colors() const { return colors; }
-    std::vector <float> get_normals() const { return normals; }
+    class CpuScope
+    {
+    private:
+        const char* name;
+        double begin;
+    public:
+        explicit CpuScope(const char* name) : name(name), begin(Profiler::instance().now()) {}
+        CpuScope(const CpuScope&) = delete;
+        CpuScope& operator =(const CpuScope&) = delete;
+        ~CpuScope() { Profiler::instance().record(name, begin, Profiler::instance().now() - begin); }
+    };
+    /* GPU time between two timestamps, only on the thread that owns the GL context */
+    class GpuScope
+    {
+    private:
+        std::size_t slot;
+    public:
+        explicit GpuScope(const char* name) : slot(Profiler::instance().begin_query(name)) {}
+        GpuScope(const GpuScope&) = delete;
+        GpuScope& operator =(const GpuScope&) = delete;
+        ~GpuScope() { Profiler::instance().end_query(slot); }
+    };
+private:
+    /* Written by its own thread only. count is published after the event, readers take events below it */
+    struct Track
+    {
+        unsigned int id = 0;
+        std::vector <Event> events = std::vector <Event>(THREAD_EVENTS);
+        std::atomic <std::size_t> count{ 0 };
+        /* Events already added to the histograms */
+        std::size_t aggregated = 0;
+    };
+    struct PendingQuery
+    {
+        const char* name = nullptr;
+        unsigned long long frame = 0;
+    };
+    /* Per-frame totals of one scope name, in a ring of the last HISTORY_FRAMES frames it appeared in */
+    struct Histogram
+    {
+        std::vector <double> frames = std::vector <double>(HISTORY_FRAMES);
+        std::size_t count = 0;
+        double current = 0.0;
+        bool seen = false;
+    };
 
-    unsigned int get_vbo() const { return vbo; };
-    unsigned int get_cbo() const { return cbo; };
-    unsigned int get_nbo() const { return nbo; };
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    /* Deque, so tracks keep their address while threads register */
+    std::deque <Track> tracks;
+    Track gpu_track;
+    std::atomic <unsigned long long> frame{ 0 };
 
-    void push_to_positions(float position) { positions.push_back(position); }
-    void push_to_colors(float color) { colors.push_back(color); }
-    void push_to_normals(float normal) { normals.push_back(normal); }
+    std::vector <unsigned int> queries;
+    std::vector <PendingQuery> pending = std::vector <PendingQuery>(GPU_QUERIES);
+    std::size_t pending_begin = 0, pending_end = 0;
+    /* GL timestamp and CPU time at the first query, to place GPU events on the CPU timeline */
+    GLint64 gpu_origin = 0;
+    double gpu_origin_cpu = 0.0;
+    unsigned long long dropped_queries = 0;
 
-    virtual void draw_shape(unsigned int& shader_source) const = 0;
+    std::unordered_map <const char*, Histogram> cpu_histograms, gpu_histograms;
+    std::vector <double> frame_ms = std::vector <double>(HISTORY_FRAMES);
+    double frame_begin = 0.0;
 
-    bool is_vbo_init() const { return vbo != 0; }
-    bool is_cbo_init() const { return cbo != 0; }
-    bool is_nbo_init() const { return nbo != 0; }
-    bool is_entirely_init() const { return is_vbo_init() and is_cbo_init() and is_nbo_init() ? true : false; }
+    Profiler() { gpu_track.id = 0; }
 
-    void init_vbo()
+    Track& local_track()
     {
-        glDeleteBuffers(1, &vbo);
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, this->positions.size() * sizeof(float), this->positions.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-    void init_cbo()
-    {
-        glDeleteBuffers(1, &cbo);
-        glGenBuffers(1, &cbo);
-        glBindBuffer(GL_ARRAY_BUFFER, cbo);
-        glBufferData(GL_ARRAY_BUFFER, this->colors.size() * sizeof(float), this->colors.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        thread_local Track* track = nullptr;
+        if (!track)
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            tracks.emplace_back();
+            tracks.back().id = static_cast <unsigned int>(tracks.size());
+            track = &tracks.back();
+        }
+        return *track;
     }
-    void init_nbo()
+    static void push(Track& track, const Event& event)
     {
-        glDeleteBuffers(1, &nbo);
-        glGenBuffers(1, &nbo);
-        glBindBuffer(GL_ARRAY_BUFFER, nbo);
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(normals[0]), normals.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        std::size_t index = track.count.load(std::memory_order_relaxed);
+        track.events[index % THREAD_EVENTS] = event;
+        track.count.store(index + 1, std::memory_order_release);
     }
-    void init_vbo(std::vector <float> positions)
+    /* Adds the events a track recorded since the last frame, consecutive events usually share a name */
+    static void aggregate(Track& track, std::unordered_map <const char*, Histogram>& histograms)
     {
-        glDeleteBuffers(1, &vbo);
-        this->positions = positions;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, this->positions.size() * sizeof(float), this->positions.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        std::size_t count = track.count.load(std::memory_order_acquire);
+        if (count - track.aggregated > THREAD_EVENTS) { track.aggregated = count - THREAD_EVENTS; }
+        const char* name = nullptr;
+        Histogram* histogram = nullptr;
+        for (; track.aggregated < count; ++track.aggregated)
+        {
+            const Event& event = track.events[track.aggregated % THREAD_EVENTS];
+            if (event.name != name)
+            {
+                name = event.name;
+                histogram = &histograms[name];
+            }
+            histogram->current += event.duration;
+            histogram->seen = true;
+        }
     }
-    void init_cbo(std::vector <float> colors)
+    static void close_frame(std::unordered_map <const char*, Histogram>& histograms)
     {
-        glDeleteBuffers(1, &cbo);
-        this->colors = colors;
-        glGenBuffers(1, &cbo);
-        glBindBuffer(GL_ARRAY_BUFFER, cbo);
-        glBufferData(GL_ARRAY_BUFFER, this->colors.size() * sizeof(float), this->colors.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (auto& entry : histograms)
+        {
+            Histogram& histogram = entry.second;
+            if (!histogram.seen) { continue; }
+            histogram.frames[histogram.count++ % HISTORY_FRAMES] = histogram.current / 1000.0;
+            histogram.current = 0.0;
+            histogram.seen = false;
+        }
     }
-    void init_nbo(std::vector <float> normals)
+    void resolve_queries()
     {
-        glDeleteBuffers(1, &nbo);
-        this->normals = normals;
-        glGenBuffers(1, &nbo);
-        glBindBuffer(GL_ARRAY_BUFFER, nbo);
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(normals[0]), normals.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        unsigned long long current = frame.load();
+        for (; pending_begin < pending_end; ++pending_begin)
+        {
+            std::size_t slot = pending_begin % GPU_QUERIES;
+            if (pending[slot].frame + QUERY_LATENCY > current) { break; }
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+            Event event;
+            event.name = pending[slot].name;
+            event.begin = gpu_origin_cpu + (static_cast <GLint64>(begin) - gpu_origin) / 1000.0;
+            event.duration = end > begin ? (end - begin) / 1000.0 : 0.0;
+            event.frame = pending[slot].frame;
+            push(gpu_track, event);
+        }
     }
-
-    virtual ~Object3D() 
+    static void write_event(std::ostream& out, const Event& event, unsigned int tid, const char* category, bool& first)
     {
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &cbo);
-        glDeleteBuffers(1, &nbo);
-    };
-};
-
-class Sphere : public Object3D, public Rotatable
-{
-private:
-    float x, y, z, r;
-public:
-    Sphere(float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality, 
-        std::vector <float> normalized_rgb, std::vector <float> normals) : Object3D(), Rotatable(), x(x), y(y), z(z), r(r)
-    { 
-        this->generate_sphere(this->x, this->y, this->z, this->r, layer_quality, density_quality);
-        if (normalized_rgb != NULL_FLOAT_VECTOR) { this->apply_colors(normalized_rgb, layer_quality, density_quality); }
-        if (normals != NULL_FLOAT_VECTOR) { this->init_nbo(normals); }
+        out << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << category << "\", \"ph\": \"X\", \"ts\": " 
+            << event.begin << ", \"dur\": " << event.duration << ", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"frame\": " << event.frame << "}}";
+        first = false;
     }
-    void generate_sphere(float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality)
+    static void write_histograms(std::ostream& out, const char* kind, const std::unordered_map <const char*, Histogram>& histograms)
     {
-        for (int i = 0; i < layer_quality; ++i)
+        std::map <std::string, const Histogram*> sorted;
+        for (const auto& entry : histograms) { sorted[entry.first] = &entry.second; }
+        for (const auto& entry : sorted)
         {
-            for (int j = 0; j < density_quality; ++j)
-            {
-
-                float x1 = x + r * cosf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
-                float y1 = y + r * sinf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
-                float z1 = z + r * cosf(j / static_cast <float>(density_quality) * PI);
-                this->push_to_positions(x1);
-                this->push_to_positions(y1);
-                this->push_to_positions(z1);
+            std::size_t count = std::min(entry.second->count, HISTORY_FRAMES);
+            std::vector <double> samples(entry.second->frames.begin(), entry.second->frames.begin() + count);
+            double maximum = samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+            out << "[Profile]: " << kind << " " << entry.first << ": p50 " << percentile(samples, 0.5) << " ms, p99 " 
+                << percentile(samples, 0.99) << " ms, max " << maximum << " ms over " << count << " frames" << std::endl;
+        }
+    }
+public:
+    Profiler(const Profiler&) = delete;
+    Profiler& operator =(const Profiler&) = delete;
 
-                float x2 = x + r * cosf(2 * PI * (i + 1) / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
-                float y2 = y + r * sinf(2 * PI * (i + 1) / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
-                float z2 = z + r * cosf(j / static_cast <float>(density_quality) * PI);
-                this->push_to_positions(x2);
-                this->push_to_positions(y2);
-                this->push_to_positions(z2);
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
 
-                float x3 = x + r * cosf(2 * PI * i / static_cast <float>(layer_quality)) * sinf((j + 1) / static_cast <float>(density_quality) * PI);
-                float y3 = y + r * sinf(2 * PI * i / static_cast <float>(layer_quality)) * sinf((j + 1) / static_cast <float>(density_quality) * PI);
-                float z3 = z + r * cosf((j + 1) / static_cast <float>(density_quality) * PI);
-                this->push_to_positions(x3);
-                this->push_to_positions(y3);
-                this->push_to_positions(z3);
+    double now() const { return std::chrono::duration <double, std::micro>(std::chrono::steady_clock::now() - origin).count(); }
+    unsigned long long get_frame() const { return frame.load(); }
 
-                this->push_to_positions(x1);
-                this->push_to_positions(y1);
-                this->push_to_positions(z1);
-                this->push_to_positions(x2);
-                this->push_to_positions(y2);
-                this->push_to_positions(z2);
+    void record(const char* name, double begin, double duration)
+    {
+        Event event;
+        event.name = name;
+        event.begin = begin;
+        event.duration = duration;
+        event.frame = frame.load(std::memory_order_relaxed);
+        push(local_track(), event);
+    }
 
-                float x4 = x + r * cosf(2 * PI * (i + 1) / static_cast <float>(layer_quality)) * sinf((j + 1) / static_cast <float>(density_quality) * PI);
-                float y4 = y + r * sinf(2 * PI * (i + 1) / static_cast <float>(layer_quality)) * sinf((j + 1) / static_cast <float>(density_quality) * PI);
-                float z4 = z + r * cosf((j + 1) / static_cast <float>(density_quality) * PI);
-                this->push_to_positions(x4);
-                this->push_to_positions(y4);
-                this->push_to_positions(z4);
-            }
+    std::size_t begin_query(const char* name)
+    {
+        if (!GLEW_ARB_timer_query) { return GPU_QUERIES; }
+        if (pending_end - pending_begin >= GPU_QUERIES)
+        {
+            ++dropped_queries;
+            return GPU_QUERIES;
+        }
+        if (queries.empty())
+        {
+            queries.resize(2 * GPU_QUERIES);
+            glGenQueries(static_cast <GLsizei>(queries.size()), queries.data());
+            glGetInteger64v(GL_TIMESTAMP, &gpu_origin);
+            gpu_origin_cpu = now();
         }
-        this->init_vbo();
+        std::size_t slot = pending_end++ % GPU_QUERIES;
+        pending[slot] = { name, frame.load() };
+        glQueryCounter(queries[2 * slot], GL_TIMESTAMP);
+        return slot;
     }
-    void apply_colors(std::vector <float> normalized_rgb, unsigned int layer_quality, unsigned int density_quality)
+    void end_query(std::size_t slot)
     {
-        int num_vertices = static_cast<int>(this->get_positions().size() / 3);
+        if (slot < GPU_QUERIES) { glQueryCounter(queries[2 * slot + 1], GL_TIMESTAMP); }
+    }
 
-        for (int i = 0; i < num_vertices; ++i)
+    /* Call once per frame on the render thread: closes the histograms of the finished frame and reads back the
+       GL queries that are QUERY_LATENCY frames old */
+    void end_frame()
+    {
+        double time = now();
+        unsigned long long finished = frame.load();
+        if (finished > 0) { frame_ms[(finished - 1) % HISTORY_FRAMES] = (time - frame_begin) / 1000.0; }
+        frame_begin = time;
+        resolve_queries();
         {
-            float gradientFactor = glm::length(glm::vec3(
-                this->get_positions()[i * 3],
-                this->get_positions()[i * 3 + 1],
-                this->get_positions()[i * 3 + 2]
-            )) / glm::length(glm::vec3(1.0));
-
-            float r = normalized_rgb[0] * (1.0 - gradientFactor);
-            float g = normalized_rgb[1] * (1.0 - gradientFactor);
-            float b = normalized_rgb[2] * (1.0 - gradientFactor);
-
-            push_to_colors(r);
-            push_to_colors(g);
-            push_to_colors(b);
+            std::lock_guard <std::mutex> lock(mutex);
+            for (Track& track : tracks) { aggregate(track, cpu_histograms); }
         }
+        aggregate(gpu_track, gpu_histograms);
+        close_frame(cpu_histograms);
+        close_frame(gpu_histograms);
+        ++frame;
+    }
 
-        this->init_cbo();
+    /* p50 / p99 / max of every scope's per-frame time */
+    void write_report(std::ostream& out)
+    {
+        unsigned long long frames = std::min <unsigned long long>(frame.load() > 0 ? frame.load() - 1 : 0, HISTORY_FRAMES);
+        std::vector <double> samples(frame_ms.begin(), frame_ms.begin() + frames);
+        out << "[Profile]: frame: p50 " << percentile(samples, 0.5) << " ms, p99 " << percentile(samples, 0.99) << " ms over " 
+            << frames << " frames" << std::endl;
+        write_histograms(out, "cpu", cpu_histograms);
+        write_histograms(out, "gpu", gpu_histograms);
+        if (dropped_queries > 0) { out << "[Profile]: " << dropped_queries << " GL scopes dropped, too many queries in flight" << std::endl; }
     }
-    void draw_shape(unsigned int& shader_source) const override
+    /* Every event still in the rings, one track per thread and one for the GPU. Makes no GL calls, so it also works
+       after the context is gone; GL scopes of the last QUERY_LATENCY frames are not read back yet and are left out */
+    void write_chrome_trace(std::ostream& out)
     {
-        unsigned int posloc = glGetAttribLocation(shader_source, "inPosition");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_vbo());
-        glVertexAttribPointer(posloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(posloc);
-
-        unsigned int colorloc = glGetAttribLocation(shader_source, "inColor");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_cbo());
-        glVertexAttribPointer(colorloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(colorloc);
-
-        unsigned int normloc = glGetAttribLocation(shader_source, "inNormal");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_nbo());
-        glVertexAttribPointer(normloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(normloc);
-
-        glDrawArrays(GL_TRIANGLES, 0, this->get_positions().size() / 3);
-
-        glDisableVertexAttribArray(posloc);
-        glDisableVertexAttribArray(colorloc);
-        glDisableVertexAttribArray(normloc);
+        std::lock_guard <std::mutex> lock(mutex);
+        bool first = true;
+        out << "{\"traceEvents\": [";
+        auto write_track = [&](const Track& track, const char* category)
+        {
+            std::size_t count = track.count.load(std::memory_order_acquire);
+            out << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << track.id 
+                << ", \"args\": {\"name\": \"" << (track.id == 0 ? "GPU" : "Thread " + std::to_string(track.id)) << "\"}}";
+            first = false;
+            for (std::size_t i = count > THREAD_EVENTS ? count - THREAD_EVENTS : 0; i < count; ++i)
+            {
+                write_event(out, track.events[i % THREAD_EVENTS], track.id, category, first);
+            }
+        };
+        for (const Track& track : tracks) { write_track(track, "cpu"); }
+        write_track(gpu_track, "gpu");
+        out << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl;
     }
-
-    void random_pure_virtual_function() override { return; }
 };
 
-class StandingCylinder : public Object3D, public Rotatable
+#define PAWN_PROFILE_CONCAT_(a, b) a##b
+#define PAWN_PROFILE_CONCAT(a, b) PAWN_PROFILE_CONCAT_(a, b)
+/* Times the rest of the enclosing block on the CPU */
+#define PAWN_CPU_SCOPE(name) Profiler::CpuScope PAWN_PROFILE_CONCAT(cpu_scope_, __LINE__)(name)
+/* Times the GL commands issued in the rest of the enclosing block on the GPU, render thread only */
+#define PAWN_GL_SCOPE(name) Profiler::GpuScope PAWN_PROFILE_CONCAT(gl_scope_, __LINE__)(name)
+#define PAWN_PROFILE_END_FRAME() Profiler::instance().end_frame()
+#else
+#define PAWN_CPU_SCOPE(name) ((void)0)
+#define PAWN_GL_SCOPE(name) ((void)0)
+#define PAWN_PROFILE_END_FRAME() ((void)0)
+#endif
+
+/* A buffer split into SECTIONS copies that the CPU writes round-robin while the GPU reads the previous ones.
+   With GL_ARB_buffer_storage it is mapped once, persistently, and each update is a memcpy of the bytes marked
+   dirty since that copy was last written, after waiting on the fence of the frame that last read it.
+   Without it the dirty bytes go through glBufferSubData into the section. The buffer object is never re-created */
+class DynamicBuffer
 {
-private:
-    float bottom_x, bottom_y, bottom_z;
-    float r, h;
 public:
-    StandingCylinder(float x, float y, float z, float r, float h, unsigned int circle_quality, unsigned int side_quality,
-        std::vector <float> normalized_rgb, std::vector <float> normals) : Object3D(), Rotatable(), bottom_x(x), bottom_y(y), bottom_z(z), r(r), h(h)
+    static const unsigned int SECTIONS = 3;
+private:
+    GLenum target = GL_ARRAY_BUFFER;
+    unsigned int buffer = 0;
+    std::size_t size = 0, section_size = 0, granularity = 1;
+    unsigned int section = 0;
+    unsigned char* mapped = nullptr;
+    GLsync fences[SECTIONS] = {};
+    /* Per section, the byte range still to be copied from the source, empty when begin >= end */
+    std::size_t dirty_begin[SECTIONS] = {}, dirty_end[SECTIONS] = {};
+
+    void release()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence) { glDeleteSync(fence); }
+            fence = nullptr;
+        }
+        if (buffer == 0) { return; }
+        if (target == GL_UNIFORM_BUFFER) { GLState::forget_uniform_buffer(buffer); }
+        glBindBuffer(target, buffer);
+        if (mapped) { glUnmapBuffer(target); }
+        glBindBuffer(target, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = nullptr;
+    }
+    void wait(GLsync& fence)
     {
-        generate_cylinder(x, y, z, r, h, circle_quality, side_quality);
-        if (normalized_rgb != NULL_FLOAT_VECTOR) { apply_color(normalized_rgb, circle_quality, side_quality); }
-        if (normals != NULL_FLOAT_VECTOR) { this->init_nbo(normals); }
+        if (!fence) { return; }
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = nullptr;
     }
+public:
+    /* granularity is what section offsets must be a multiple of: the offset alignment of uniform buffers,
+       or the vertex size for vertex data drawn with a base vertex */
+    DynamicBuffer(GLenum target, std::size_t granularity) : target(target), granularity(std::max <std::size_t>(granularity, 1)) {}
+    DynamicBuffer(const DynamicBuffer&) = delete;
+    DynamicBuffer& operator =(const DynamicBuffer&) = delete;
 
-    void apply_color(std::vector <float> normalized_rgb, unsigned int circle_quality, unsigned int side_quality)
+    /* Re-creates the storage for size bytes per section, everything becomes dirty */
+    void resize(std::size_t size)
     {
-        int num_vertices = static_cast<int>(this->get_positions().size() / 3);
-
-        for (int i = 0; i < num_vertices; ++i)
+        release();
+        this->size = size;
+        section_size = (std::max <std::size_t>(size, 1) + granularity - 1) / granularity * granularity;
+        section = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if (GLEW_ARB_buffer_storage)
         {
-            // Calculate the normalized gradient factor based on the vertex's position
-            float gradientFactor = glm::length(glm::vec3(
-                this->get_positions()[i * 3],
-                this->get_positions()[i * 3 + 1],
-                this->get_positions()[i * 3 + 2]
-            )) / glm::length(glm::vec3(1.0));
-
-            // Darken the input color based on the gradient factor
-            float r = normalized_rgb[0] * (1.0 - gradientFactor);
-            float g = normalized_rgb[1] * (1.0 - gradientFactor);
-            float b = normalized_rgb[2] * (1.0 - gradientFactor);
-
-            // Add the darkened color to the colors vector
-            push_to_colors(r);
-            push_to_colors(g);
-            push_to_colors(b);
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            /* Dynamic storage keeps glBufferSubData usable should the mapping fail */
+            glBufferStorage(target, section_size * SECTIONS, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+            mapped = static_cast <unsigned char*>(glMapBufferRange(target, 0, section_size * SECTIONS, flags));
         }
-
-        this->init_cbo();
+        else
+        {
+            glBufferData(target, section_size * SECTIONS, nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBindBuffer(target, 0);
+        mark_dirty(0, size);
     }
-    void generate_cylinder(float bx, float by, float bz, float r, float h, unsigned int circle_quality, unsigned int side_quality)
+    void mark_dirty(std::size_t offset, std::size_t bytes)
     {
-        for (int i = 0; i < circle_quality; i++)
+        for (unsigned int i = 0; i < SECTIONS; ++i)
         {
-            float x = bx + r * cosf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
-            float z = bz + r * sinf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
-
-            float xnext = bx + r * cosf(2.0f * PI * static_cast <float>(i + 1) / static_cast <float>(circle_quality));
-            float znext = bz + r * sinf(2.0f * PI * static_cast <float>(i + 1) / static_cast <float>(circle_quality));
-
-            this->push_to_positions(x); this->push_to_positions(by); this->push_to_positions(z);
-            this->push_to_positions(xnext); this->push_to_positions(by); this->push_to_positions(znext);
-            this->push_to_positions(bx); this->push_to_positions(by); this->push_to_positions(bz);
+            bool empty = dirty_begin[i] >= dirty_end[i];
+            dirty_begin[i] = empty ? offset : std::min(dirty_begin[i], offset);
+            dirty_end[i] = empty ? offset + bytes : std::max(dirty_end[i], offset + bytes);
+        }
+    }
+    /* Call once per frame before drawing from the buffer: fences the section the last frame read, moves to the
+       next one and brings its dirty bytes up to date from source, which mirrors the whole buffer contents */
+    void update(const void* source)
+    {
+        PAWN_CPU_SCOPE("stream");
+        PAWN_GL_SCOPE("stream");
+        if (buffer == 0) { return; }
+        if (mapped)
+        {
+            if (fences[section]) { glDeleteSync(fences[section]); }
+            fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
         }
-        for (int i = 0; i < circle_quality; i++)
+        section = (section + 1) % SECTIONS;
+        std::size_t begin = dirty_begin[section], end = std::min(dirty_end[section], size);
+        if (begin < end)
         {
-            float x = bx + r * cosf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
-            float z = bz + r * sinf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
+            const unsigned char* bytes = static_cast <const unsigned char*>(source) + begin;
+            if (mapped)
+            {
+                wait(fences[section]);
+                std::memcpy(mapped + section * section_size + begin, bytes, end - begin);
+            }
+            else
+            {
+                GL_COUNTED(glBindBuffer(target, buffer));
+                GL_COUNTED(glBufferSubData(target, section * section_size + begin, end - begin, bytes));
+                GL_COUNTED(glBindBuffer(target, 0));
+            }
+        }
+        dirty_begin[section] = dirty_end[section] = 0;
+    }
 
-            float xnext = bx + r * cosf(2.0f * PI * static_cast <float>(i + 1) / static_cast <float>(circle_quality));
-            float znext = bz + r * sinf(2.0f * PI * static_cast <float>(i + 1) / static_cast <float>(circle_quality));
+    unsigned int get_id() const { return buffer; }
+    bool is_persistent() const { return mapped != nullptr; }
+    std::size_t get_size() const { return size; }
+    /* Byte offset of the section the GPU should read this frame */
+    std::size_t get_offset() const { return section * section_size; }
 
-            this->push_to_positions(x); this->push_to_positions(by + h); this->push_to_positions(z);
-            this->push_to_positions(xnext); this->push_to_positions(by + h); this->push_to_positions(znext);
-            this->push_to_positions(bx); this->push_to_positions(by + h); this->push_to_positions(bz);
-        }
+    ~DynamicBuffer() { release(); }
+};
 
-        for (int i = 0; i < side_quality; i++)
-        {
-            float x = bx + r * cosf(2 * PI * static_cast <float>(i) / static_cast <float>(side_quality));
-            float z = bz + r * sinf(2 * PI * static_cast <float>(i) / static_cast <float>(side_quality));
-            float xnext = bx + r * cosf(2 * PI * static_cast <float>(i + 1) / static_cast <float>(side_quality));
-            float znext = bz + r * sinf(2 * PI * static_cast <float>(i + 1) / static_cast <float>(side_quality));
+/* Linked program with its active uniforms and uniform blocks reflected once into lookup tables. Attribute locations
+   are fixed by layout qualifiers instead (see POSITION_ATTRIBUTE), since one VAO serves every program */
+class ShaderProgram
+{
+private:
+    unsigned int id = 0;
+    std::unordered_map <std::string, int> uniforms;
+    std::unordered_map <std::string, unsigned int> uniform_blocks;
 
-            this->push_to_positions(x); this->push_to_positions(by); this->push_to_positions(z);
-            this->push_to_positions(xnext); this->push_to_positions(by); this->push_to_positions(znext);
-            this->push_to_positions(x); this->push_to_positions(by + h); this->push_to_positions(z);
+    void reflect()
+    {
+        int count = 0, max_length = 0;
 
-            this->push_to_positions(xnext); this->push_to_positions(by); this->push_to_positions(znext);
-            this->push_to_positions(xnext); this->push_to_positions(by + h); this->push_to_positions(znext);
-            this->push_to_positions(x); this->push_to_positions(by + h); this->push_to_positions(z);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        std::string name(std::max(max_length, 1), '\0');
+        for (int i = 0; i < count; ++i)
+        {
+            int length = 0, size = 0;
+            unsigned int type = 0;
+            glGetActiveUniform(id, i, max_length, &length, &size, &type, name.data());
+            std::string uniform = name.substr(0, length);
+            int location = glGetUniformLocation(id, uniform.c_str());
+            uniforms[uniform] = location;
+            /* Arrays are reported as "name[0]", make them reachable by their plain name too */
+            std::size_t bracket = uniform.find('[');
+            if (bracket != std::string::npos) { uniforms[uniform.substr(0, bracket)] = location; }
         }
 
-        this->init_vbo();
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+        name.assign(std::max(max_length, 1), '\0');
+        for (int i = 0; i < count; ++i)
+        {
+            int length = 0;
+            glGetActiveUniformBlockName(id, i, max_length, &length, name.data());
+            uniform_blocks[name.substr(0, length)] = static_cast <unsigned int>(i);
+        }
     }
-    void draw_shape(unsigned int& shader_source) const override
+public:
+    ShaderProgram(const ShaderProgramInfo& source) : ShaderProgram(createShader(source.vertexShaderProgramInfo, source.fragmentShaderProgramInfo)) {}
+    /* Takes ownership of a linked program, 0 for one that failed to build */
+    explicit ShaderProgram(unsigned int id) : id(id)
     {
-        unsigned int posloc = glGetAttribLocation(shader_source, "inPosition");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_vbo());
-        glVertexAttribPointer(posloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(posloc);
+        if (id != 0) { reflect(); }
+    }
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator =(const ShaderProgram&) = delete;
 
-        unsigned int colorloc = glGetAttribLocation(shader_source, "inColor");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_cbo());
-        glVertexAttribPointer(colorloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(colorloc);
+    unsigned int get_id() const { return id; }
+    bool is_linked() const { return id != 0; }
+    /* Exchanges the GL programs, so holders of this object see a rebuilt program */
+    void swap(ShaderProgram& other)
+    {
+        std::swap(id, other.id);
+        uniforms.swap(other.uniforms);
+        uniform_blocks.swap(other.uniform_blocks);
+    }
+    /* Returns -1 for names that are not active in the linked program, like glGetUniformLocation */
+    int uniform(const std::string& name) const
+    {
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second : -1;
+    }
 
-        unsigned int normloc = glGetAttribLocation(shader_source, "inNormal");
-        glBindBuffer(GL_ARRAY_BUFFER, this->get_nbo());
-        glVertexAttribPointer(normloc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(normloc);
+    /* Connects a uniform block to a buffer binding point, ignored when the block is not active */
+    void bind_uniform_block(const std::string& name, unsigned int binding) const
+    {
+        auto it = uniform_blocks.find(name);
+        if (it != uniform_blocks.end()) { glUniformBlockBinding(id, it->second, binding); }
+    }
 
-        glDrawArrays(GL_TRIANGLES, 0, this->get_positions().size() / 3);
+    void use() const { GLState::use_program(id); }
 
-        glDisableVertexAttribArray(posloc);
-        glDisableVertexAttribArray(colorloc);
-        glDisableVertexAttribArray(normloc);
+    ~ShaderProgram()
+    {
+        if (id == 0) { return; }
+        GLState::forget_program(id);
+        glDeleteProgram(id);
     }
-
-    void random_pure_virtual_function() override { return; }
 };
 
-class Composition
+/* Builds shader programs, at most one per distinct source. Linked programs are kept on disk as driver binaries
+   (GL_ARB_get_program_binary) so later launches skip compilation, and programs loaded from files are rebuilt in
+   place when the file changes */
+class ShaderManager
 {
 private:
-    std::vector <Object3D*> figures;
-public:
-    void add(Object3D* obj)
+    struct ProgramFileHeader
     {
-        figures.push_back(obj);
-    }
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t format;
+        std::uint64_t source_hash;
+        /* Binaries are only valid for the driver that produced them */
+        std::uint64_t driver_hash;
+        std::uint32_t length;
+    };
+    struct Watch
+    {
+        std::string path;
+        std::uint64_t source_hash = 0;
+        std::weak_ptr <ShaderProgram> program;
+        std::filesystem::file_time_type modified;
+    };
+
+    std::map <std::uint64_t, std::weak_ptr <ShaderProgram>> programs;
+    std::vector <Watch> watches;
+    /* Where program binaries persist between runs, empty to always compile */
+    std::string directory;
+    ShaderTimings timings;
+#ifdef __linux__
+    int inotify = -1;
+    std::map <int, std::string> watched_directories;
+#endif
 
-    void init_rotation(unsigned int& shader)
+    ShaderManager() = default;
+
+    static std::uint64_t hash_source(const ShaderProgramInfo& source)
     {
-        for (const auto& i : figures)
+        std::uint64_t hash = fnv1a(source.vertexShaderProgramInfo.data(), source.vertexShaderProgramInfo.size());
+        const char separator = '\0';
+        hash = fnv1a(&separator, 1, hash);
+        return fnv1a(source.fragmentShaderProgramInfo.data(), source.fragmentShaderProgramInfo.size(), hash);
+    }
+    static std::uint64_t hash_driver()
+    {
+        std::uint64_t hash = fnv1a(nullptr, 0);
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
         {
-            if (Rotatable* r = dynamic_cast <Rotatable*>(i))
-            {
-                r->init_rotation(shader);
-            }
+            const char* value = reinterpret_cast <const char*>(glGetString(name));
+            if (value) { hash = fnv1a(value, std::strlen(value), hash); }
         }
+        return hash;
+    }
+    std::string binary_path(std::uint64_t source_hash) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.program", static_cast <unsigned long long>(source_hash));
+        return directory + "/" + name;
     }
 
-    void apply_rotation(unsigned int& shader)
+    unsigned int load_binary(std::uint64_t source_hash)
     {
-        for (const auto& i : figures)
+        if (directory.empty() || !GLEW_ARB_get_program_binary) { return 0; }
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream stream(binary_path(source_hash), std::ios::binary);
+        ProgramFileHeader header;
+        if (!stream.read(reinterpret_cast <char*>(&header), sizeof(header)) || std::memcmp(header.magic, "PAWNPROG", 8) != 0 || 
+            header.version != 1 || header.source_hash != source_hash || header.driver_hash != hash_driver())
         {
-            if (Rotatable* r = dynamic_cast <Rotatable*>(i))
-            {
-                r->apply_rotation(shader);
-            }
+            return 0;
         }
-    }
+        std::vector <char> binary(header.length);
+        if (!stream.read(binary.data(), binary.size())) { return 0; }
 
-    void draw_composition(unsigned int& shader)
-    {
-        for (const auto& i : figures)
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast <GLsizei>(binary.size()));
+        int result = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &result);
+        /* Drivers reject binaries after an update, fall back to compiling */
+        if (result == GL_FALSE)
         {
-            i->draw_shape(shader);
+            glDeleteProgram(program);
+            return 0;
         }
+        timings = ShaderTimings();
+        timings.from_binary = true;
+        timings.binary_ms = std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return program;
     }
-    ~Composition()
+    /* Through a temporary file like write_mesh_file, so a concurrent run never loads half a binary */
+    void store_binary(unsigned int program, std::uint64_t source_hash)
     {
-        for (auto& i : figures)
+        if (directory.empty() || !GLEW_ARB_get_program_binary) { return; }
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) { return; }
+        std::vector <char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+        ProgramFileHeader header = {};
+        std::memcpy(header.magic, "PAWNPROG", 8);
+        header.version = 1;
+        header.format = format;
+        header.source_hash = source_hash;
+        header.driver_hash = hash_driver();
+        header.length = static_cast <std::uint32_t>(length);
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::string path = binary_path(source_hash);
+        std::string temporary = path + "." + std::to_string(std::hash <std::thread::id>()(std::this_thread::get_id())) + ".tmp";
         {
-            delete i;
+            std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+            if (!stream) { return; }
+            stream.write(reinterpret_cast <const char*>(&header), sizeof(header));
+            stream.write(binary.data(), binary.size());
+            if (!stream) { return; }
         }
+        std::filesystem::rename(temporary, path, error);
     }
-};
-
-int main(int argc, char** argv)
-{
-    GLFWwindow* window;
 
-    if (!glfwInit())
+    /* A new program object for source, from the binary cache when possible */
+    std::shared_ptr <ShaderProgram> build(const ShaderProgramInfo& source, std::uint64_t source_hash)
     {
-        std::cout << "[GLFW]: Initialization Error!\n";
-        return -1;
+        /* A failed compile leaves them untouched */
+        timings = ShaderTimings();
+        unsigned int id = load_binary(source_hash);
+        if (id == 0)
+        {
+            id = createShader(source.vertexShaderProgramInfo, source.fragmentShaderProgramInfo, &timings, !directory.empty());
+            if (id != 0) { store_binary(id, source_hash); }
+        }
+        if (timings.from_binary) { std::cout << "[Shader]: Loaded program binary in " << timings.binary_ms << " ms" << std::endl; }
+        else
+        {
+            std::cout << "[Shader]: Compiled in " << timings.compile_ms << " ms, linked in " << timings.link_ms << " ms" << std::endl;
+        }
+        return std::make_shared <ShaderProgram>(id);
     }
-    window = glfwCreateWindow(640, 640, "GLFW", NULL, NULL);
-    if (!window)
+
+    void watch(const std::string& path, std::uint64_t source_hash, const std::shared_ptr <ShaderProgram>& program)
     {
-        std::cout << "[GLFW]: Window Creation Error!\n";
-        return -1;
+        std::error_code error;
+        watches.push_back({ path, source_hash, program, std::filesystem::last_write_time(path, error) });
+#ifdef __linux__
+        if (inotify < 0) { inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); }
+        if (inotify < 0) { return; }
+        /* Editors often save by renaming a new file over the old one, so the directory is watched, not the file */
+        std::string parent = std::filesystem::path(path).parent_path().string();
+        if (parent.empty()) { parent = "."; }
+        for (const auto& watched : watched_directories) { if (watched.second == parent) { return; } }
+        int descriptor = inotify_add_watch(inotify, parent.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (descriptor >= 0) { watched_directories[descriptor] = parent; }
+#endif
     }
-    glfwMakeContextCurrent(window);
-    if (glewInit() != GLEW_OK)
+    /* Files that changed since the last call */
+    std::vector <std::string> changed_files()
+    {
+        std::vector <std::string> changed;
+#ifdef __linux__
+        if (inotify < 0) { return changed; }
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + reinterpret_cast <inotify_event*>(p)->len)
+            {
+                const inotify_event* event = reinterpret_cast <inotify_event*>(p);
+                auto directory = watched_directories.find(event->wd);
+                if (directory == watched_directories.end() || event->len == 0) { continue; }
+                changed.push_back((std::filesystem::path(directory->second) / event->name).string());
+            }
+        }
+#else
+        /* Without inotify, compare modification times */
+        for (Watch& watch : watches)
+        {
+            std::error_code error;
+            auto modified = std::filesystem::last_write_time(watch.path, error);
+            if (!error && modified != watch.modified)
+            {
+                watch.modified = modified;
+                changed.push_back(watch.path);
+            }
+        }
+#endif
+        return changed;
+    }
+public:
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator =(const ShaderManager&) = delete;
+
+    static ShaderManager& instance()
+    {
+        static ShaderManager manager;
+        return manager;
+    }
+
+    void set_directory(const std::string& directory) { this->directory = directory; }
+    /* Timings of the last program built */
+    const ShaderTimings& get_timings() const { return timings; }
+
+    /* Returns the live program built from the same source, or builds one */
+    std::shared_ptr <ShaderProgram> create(const ShaderProgramInfo& source)
+    {
+        std::uint64_t source_hash = hash_source(source);
+        if (std::shared_ptr <ShaderProgram> program = programs[source_hash].lock()) { return program; }
+        std::shared_ptr <ShaderProgram> program = build(source, source_hash);
+        if (program->is_linked()) { programs[source_hash] = program; }
+        return program;
+    }
+    /* Like create() for the contents of path, and rebuilds the program when the file changes, see poll() */
+    std::shared_ptr <ShaderProgram> load(const std::string& path)
+    {
+        ShaderProgramInfo source = parseShader(path);
+        std::shared_ptr <ShaderProgram> program = create(source);
+        watch(path, hash_source(source), program);
+        return program;
+    }
+    /* Call once per frame. Rebuilds programs whose file changed, keeping the ShaderProgram objects, and returns
+       true when any was replaced: uniform locations and block bindings must then be set up again.
+       A source that fails to build keeps the previous program */
+    bool poll()
+    {
+        std::vector <std::string> changed = changed_files();
+        bool replaced = false;
+        for (Watch& watch : watches)
+        {
+            std::shared_ptr <ShaderProgram> program = watch.program.lock();
+            if (!program) { continue; }
+            bool match = std::any_of(changed.begin(), changed.end(), [&watch](const std::string& path)
+            {
+                std::error_code error;
+                return std::filesystem::equivalent(path, watch.path, error);
+            });
+            if (!match) { continue; }
+
+            ShaderProgramInfo source = parseShader(watch.path);
+            std::uint64_t source_hash = hash_source(source);
+            if (source_hash == watch.source_hash) { continue; }
+            std::shared_ptr <ShaderProgram> rebuilt = build(source, source_hash);
+            if (!rebuilt->is_linked())
+            {
+                std::cout << "[Shader]: Keeping the previous program of " << watch.path << std::endl;
+                continue;
+            }
+            program->swap(*rebuilt);
+            /* The program no longer holds the old source, create() must not hand it out for it */
+            auto previous = programs.find(watch.source_hash);
+            if (previous != programs.end() && previous->second.lock() == program) { programs.erase(previous); }
+            programs[source_hash] = program;
+            watch.source_hash = source_hash;
+            replaced = true;
+            std::cout << "[Shader]: Reloaded " << watch.path << std::endl;
+        }
+        return replaced;
+    }
+
+    ~ShaderManager()
+    {
+#ifdef __linux__
+        if (inotify >= 0) { close(inotify); }
+#endif
+    }
+};
+
+/* Default spin of a Rotatable, about 0.001 rad per frame at 60 fps */
+const float DEFAULT_ANGULAR_SPEED = 0.06f;
+
+/* Marks an object that spins around pivot, the spin itself is driven by the TransformSystem of its composition */
+class Rotatable
+{
+private:
+    glm::vec3 pivot;
+    float angular_speed;
+public:
+    Rotatable() : pivot(glm::vec3(0.3f, 0.3f, 0.3f)), angular_speed(DEFAULT_ANGULAR_SPEED) {}
+    Rotatable(glm::vec3 pivot) : pivot(pivot), angular_speed(DEFAULT_ANGULAR_SPEED) {}
+
+    glm::vec3 get_pivot() const { return pivot; }
+    void set_pivot(glm::vec3 pivot) { this->pivot = pivot; }
+    /* Radians per second */
+    float get_angular_speed() const { return angular_speed; }
+    void set_angular_speed(float angular_speed) { this->angular_speed = angular_speed; }
+
+    virtual void random_pure_virtual_function() = 0;
+    virtual ~Rotatable() {};
+};
+
+/* Vertex attribute locations, fixed by layout qualifiers in pawn.shader */
+enum VertexAttribute : unsigned int
+{
+    POSITION_ATTRIBUTE = 0, COLOR_ATTRIBUTE = 1, NORMAL_ATTRIBUTE = 2,
+    /* mat4 attribute, occupies four consecutive locations */
+    INSTANCE_TRANSFORM_ATTRIBUTE = 3, INSTANCE_COLOR_ATTRIBUTE = 7
+};
+
+/* Instance attributes and the vertex color fall back to these current values when their arrays are disabled, so
+   non-instanced draws see an identity instance transform and meshes without a color buffer are white before the material */
+void init_instance_attribute_defaults()
+{
+    glVertexAttrib3f(COLOR_ATTRIBUTE, 1.0f, 1.0f, 1.0f);
+    glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+    glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 3, 0.0f, 0.0f, 0.0f, 1.0f);
+    glVertexAttrib3f(INSTANCE_COLOR_ATTRIBUTE, 1.0f, 1.0f, 1.0f);
+}
+
+/* Axis-aligned box, empty until the first point is added */
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits <float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits <float>::max());
+
+    bool is_empty() const { return min.x > max.x; }
+    void expand(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void expand(const Bounds& other)
+    {
+        if (other.is_empty()) { return; }
+        expand(other.min);
+        expand(other.max);
+    }
+    glm::vec3 get_center() const { return (min + max) * 0.5f; }
+    /* Radius of the sphere around the box */
+    float get_radius() const { return glm::length(max - min) * 0.5f; }
+
+    /* Conservative box of this box under transform, through its bounding sphere */
+    Bounds transformed(const glm::mat4& transform) const
+    {
+        Bounds result;
+        if (is_empty()) { return result; }
+        glm::vec3 center = glm::vec3(transform * glm::vec4(get_center(), 1.0f));
+        float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+        glm::vec3 extent = glm::vec3(get_radius() * scale);
+        result.min = center - extent;
+        result.max = center + extent;
+        return result;
+    }
+};
+
+/* Colors are not part of the vertex: shapes are colored by their Material, and only meshes that really have
+   per-vertex colors (imported ones, or edited through set_color) carry a separate color buffer */
+struct Vertex
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+};
+
+/* Points the currently bound VAO at an interleaved Vertex buffer, its element buffer and, when cbo is not 0,
+   a tightly packed color buffer */
+void record_vertex_layout(unsigned int vbo, unsigned int ibo, unsigned int cbo = 0)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast <void*>(offsetof(Vertex, position)));
+    glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+    glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast <void*>(offsetof(Vertex, normal)));
+    glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+    if (cbo == 0)
+    {
+        glDisableVertexAttribArray(COLOR_ATTRIBUTE);
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, cbo);
+    glVertexAttribPointer(COLOR_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+    glEnableVertexAttribArray(COLOR_ATTRIBUTE);
+}
+
+/* Surface color evaluated in the fragment shader: color, darkened by gradient times the distance from the object's
+   origin (the gradient formerly baked into every vertex). Multiplies per-vertex and instance colors */
+struct Material
+{
+    glm::vec3 color = glm::vec3(1.0f);
+    float gradient = 0.0f;
+
+    static Material make_solid(const glm::vec3& color) { return { color, 0.0f }; }
+    static Material make_gradient(const glm::vec3& color) { return { color, 1.0f }; }
+    /* From a normalized rgb list, as the shape constructors take it */
+    static Material make_gradient(const std::vector <float>& normalized_rgb)
+    {
+        return make_gradient(glm::vec3(normalized_rgb[0], normalized_rgb[1], normalized_rgb[2]));
+    }
+    bool operator ==(const Material& other) const { return color == other.color && gradient == other.gradient; }
+    bool operator !=(const Material& other) const { return !(*this == other); }
+};
+
+/* Uniform locations of the material in a program */
+struct MaterialLocations
+{
+    int color = -1;
+    int gradient = -1;
+
+    void init(const ShaderProgram& shader)
+    {
+        color = shader.uniform("materialColor");
+        gradient = shader.uniform("materialGradient");
+    }
+    void apply(const Material& material) const
+    {
+        GL_COUNTED(glUniform3f(color, material.color.x, material.color.y, material.color.z));
+        GL_COUNTED(glUniform1f(gradient, material.gradient));
+    }
+};
+
+/* CPU copy and GPU buffers of one tessellated shape, shared by every Object3D built with the same parameters */
+class Mesh
+{
+private:
+    std::vector <Vertex> vertices;
+    std::vector <unsigned int> indices;
+    /* Empty unless the mesh has per-vertex colors, then one per vertex, uploaded to cbo */
+    std::vector <glm::vec3> colors;
+    unsigned int vao = 0, vbo = 0, ibo = 0, cbo = 0;
+    /* Sizes of the uploaded buffers, still valid after the CPU copy is released */
+    std::size_t vertex_count = 0, index_count = 0;
+    bool has_cpu_copy = true;
+    /* Bumped by every upload and vertex edit, so copies of the GPU data can tell they are stale */
+    unsigned int version = 0;
+    /* Set by make_dynamic(), then vbo is this ring and each frame draws from its current section */
+    std::unique_ptr <DynamicBuffer> dynamic_vertices;
+    unsigned long long streamed_frame = 0;
+    /* Set by the generators, otherwise computed from the vertices on upload */
+    Bounds bounds;
+
+    const unsigned int DIMENSIONS = 3;
+public:
+    Mesh() = default;
+    Mesh(std::vector <Vertex>&& vertices, std::vector <unsigned int>&& indices) : vertices(std::move(vertices)), indices(std::move(indices)) {}
+    Mesh(const Mesh&) = delete;
+    Mesh& operator =(const Mesh&) = delete;
+
+    /* Empty once release_cpu_copy() has been called */
+    const std::vector <Vertex>& get_vertices() const { return vertices; }
+    const std::vector <unsigned int>& get_indices() const { return indices; }
+    std::size_t get_vertex_count() const { return has_cpu_copy ? vertices.size() : vertex_count; }
+    std::size_t get_index_count() const { return has_cpu_copy ? indices.size() : index_count; }
+    std::size_t get_byte_size() const
+    {
+        return get_vertex_count() * sizeof(Vertex) + get_index_count() * sizeof(unsigned int) + (has_colors() ? get_vertex_count() * sizeof(glm::vec3) : 0);
+    }
+    const std::vector <glm::vec3>& get_colors() const { return colors; }
+    bool has_colors() const { return !colors.empty() || cbo != 0; }
+    /* What a per-vertex color stream would have cost this mesh, 0 when it has one */
+    std::size_t get_color_bytes_saved() const { return has_colors() ? 0 : get_vertex_count() * sizeof(glm::vec3); }
+    bool is_cpu_copy_kept() const { return has_cpu_copy; }
+    unsigned int get_version() const { return version; }
+    const Bounds& get_bounds() const { return bounds; }
+    void set_bounds(const Bounds& bounds) { this->bounds = bounds; }
+
+    unsigned int get_vao() const { return vao; };
+    unsigned int get_vbo() const { return vbo; };
+    unsigned int get_ibo() const { return ibo; };
+    unsigned int get_cbo() const { return cbo; };
+    bool is_dynamic() const { return dynamic_vertices != nullptr; }
+    /* First vertex of this frame's ring section inside vbo, 0 for static meshes */
+    GLint get_base_vertex() const { return dynamic_vertices ? static_cast <GLint>(dynamic_vertices->get_offset() / sizeof(Vertex)) : 0; }
+
+    /* Appends a unique vertex and returns its index for use in the element buffer */
+    unsigned int push_vertex(float x, float y, float z)
+    {
+        Vertex vertex;
+        vertex.position = glm::vec3(x, y, z);
+        vertices.push_back(vertex);
+        return static_cast <unsigned int>(vertices.size() - 1);
+    }
+    void push_triangle(unsigned int a, unsigned int b, unsigned int c)
+    {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+    /* The first edit gives the mesh a white color stream */
+    void set_color(unsigned int index, float r, float g, float b)
+    {
+        if (colors.size() != vertices.size()) { colors.assign(vertices.size(), glm::vec3(1.0f)); }
+        colors[index] = glm::vec3(r, g, b);
+    }
+    void set_normal(unsigned int index, float x, float y, float z) { vertices[index].normal = glm::vec3(x, y, z); }
+    /* Takes over vertex and index data built elsewhere, ready for upload() */
+    void assign(std::vector <Vertex>&& vertices, std::vector <unsigned int>&& indices)
+    {
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        colors.clear();
+        has_cpu_copy = true;
+    }
+    /* Per-vertex colors for the assigned vertices, one per vertex */
+    void assign_colors(std::vector <glm::vec3>&& colors) { this->colors = std::move(colors); }
+    /* Pre-sizes the buffers for kernels that write vertices and indices in place */
+    void resize(std::size_t vertex_count, std::size_t index_count)
+    {
+        vertices.resize(vertex_count);
+        indices.resize(index_count);
+    }
+    Vertex* vertex_data() { return vertices.data(); }
+    unsigned int* index_data() { return indices.data(); }
+    /* Darkens normalized_rgb by each vertex's distance from the origin, in one linear pass over the vertices */
+    void bake_gradient_colors(const std::vector <float>& normalized_rgb)
+    {
+        const glm::vec3 base(normalized_rgb[0], normalized_rgb[1], normalized_rgb[2]);
+        const float inverse_norm = 1.0f / glm::length(glm::vec3(1.0f));
+        const Vertex* in = vertices.data();
+        const std::size_t count = vertices.size();
+        colors.resize(count);
+        glm::vec3* out = colors.data();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const glm::vec3& p = in[i].position;
+            const float shade = 1.0f - std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z) * inverse_norm;
+            out[i] = base * shade;
+        }
+    }
+    /* Normals are given as a flat xyz list, one triple per unique vertex */
+    void apply_normals(const std::vector <float>& normals)
+    {
+        std::size_t count = std::min(normals.size() / DIMENSIONS, vertices.size());
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            this->set_normal(i, normals[i * DIMENSIONS], normals[i * DIMENSIONS + 1], normals[i * DIMENSIONS + 2]);
+        }
+    }
+
+    bool is_vao_init() const { return vao != 0; }
+    bool is_vbo_init() const { return vbo != 0; }
+    bool is_ibo_init() const { return ibo != 0; }
+    bool is_entirely_init() const { return is_vao_init() and is_vbo_init() and is_ibo_init() ? true : false; }
+
+    /* Box of the vertices, unless the generator already set one */
+    void compute_bounds()
+    {
+        if (!bounds.is_empty()) { return; }
+        for (const auto& vertex : vertices) { bounds.expand(vertex.position); }
+    }
+    /* Uploads vertices and indices and records the interleaved layout once, so drawing is a single VAO bind */
+    void upload()
+    {
+        this->compute_bounds();
+        this->upload_buffers(vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+    void upload(std::vector <Vertex>&& vertices, std::vector <unsigned int>&& indices)
+    {
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        colors.clear();
+        has_cpu_copy = true;
+        this->upload();
+    }
+    /* Uploads straight from memory the mesh does not own, such as a mapped cache file. No CPU copy is kept */
+    void upload(const Vertex* vertex_data, std::size_t vertex_count, const unsigned int* index_data, std::size_t index_count, const Bounds& bounds)
+    {
+        std::vector <Vertex>().swap(vertices);
+        std::vector <unsigned int>().swap(indices);
+        std::vector <glm::vec3>().swap(colors);
+        has_cpu_copy = false;
+        this->bounds = bounds;
+        this->upload_buffers(vertex_data, vertex_count, index_data, index_count);
+    }
+private:
+    void upload_buffers(const Vertex* vertex_data, std::size_t vertex_count, const unsigned int* index_data, std::size_t index_count)
+    {
+        PAWN_CPU_SCOPE("upload");
+        PAWN_GL_SCOPE("upload");
+        this->vertex_count = vertex_count;
+        this->index_count = index_count;
+        ++version;
+        /* A full upload makes the mesh static again */
+        if (dynamic_vertices)
+        {
+            dynamic_vertices.reset();
+            vbo = 0;
+        }
+
+        GLState::forget_vertex_array(vao);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        glDeleteBuffers(1, &cbo);
+        cbo = 0;
+
+        glGenVertexArrays(1, &vao);
+        GLState::bind_vertex_array(vao);
+
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(Vertex), vertex_data, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(unsigned int), index_data, GL_STATIC_DRAW);
+
+        if (colors.size() == vertex_count && vertex_count != 0)
+        {
+            glGenBuffers(1, &cbo);
+            glBindBuffer(GL_ARRAY_BUFFER, cbo);
+            glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(glm::vec3), colors.data(), GL_STATIC_DRAW);
+        }
+
+        this->record_vertex_layout();
+
+        /* The element buffer binding is VAO state, so only the array buffer is unbound */
+        GLState::bind_vertex_array(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+public:
+    /* Frees the CPU-side vertices and indices of an uploaded static mesh, roughly halving its resident
+       memory. The mesh can still be drawn but no longer edited or re-uploaded */
+    void release_cpu_copy()
+    {
+        /* Dynamic meshes stream from the CPU copy every frame */
+        if (!is_vao_init() || is_dynamic()) { return; }
+        std::vector <Vertex>().swap(vertices);
+        std::vector <unsigned int>().swap(indices);
+        std::vector <glm::vec3>().swap(colors);
+        has_cpu_copy = false;
+    }
+    /* Points the currently bound VAO at this mesh's buffers, also used by VAOs that share the mesh */
+    void record_vertex_layout() const { ::record_vertex_layout(vbo, ibo, cbo); }
+
+    /* Moves the vertices of an uploaded mesh into a DynamicBuffer, for meshes edited every few frames.
+       Sharers drawing through their own VAO must record_vertex_layout() again */
+    void make_dynamic()
+    {
+        if (!is_vao_init() || !has_cpu_copy || is_dynamic()) { return; }
+        dynamic_vertices = std::make_unique <DynamicBuffer>(GL_ARRAY_BUFFER, sizeof(Vertex));
+        dynamic_vertices->resize(vertices.size() * sizeof(Vertex));
+        glDeleteBuffers(1, &vbo);
+        vbo = dynamic_vertices->get_id();
+        GLState::bind_vertex_array(vao);
+        this->record_vertex_layout();
+        GLState::bind_vertex_array(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    /* Publishes edits to vertices [first, first + count) of the CPU copy without re-creating any buffer.
+       Dynamic meshes copy them into each ring section as it comes round, static ones update the range in place */
+    void mark_vertices_dirty(std::size_t first, std::size_t count)
+    {
+        if (!is_vao_init() || !has_cpu_copy) { return; }
+        count = std::min(count, vertices.size() - std::min(first, vertices.size()));
+        if (count == 0) { return; }
+        ++version;
+        /* Colors stay in a static buffer, also for dynamic meshes */
+        if (colors.size() == vertices.size())
+        {
+            if (cbo == 0)
+            {
+                /* First colored edit: the whole stream is new, sharers with their own VAO must record_vertex_layout() again */
+                glGenBuffers(1, &cbo);
+                GL_COUNTED(glBindBuffer(GL_ARRAY_BUFFER, cbo));
+                GL_COUNTED(glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(glm::vec3), colors.data(), GL_STATIC_DRAW));
+                GLState::bind_vertex_array(vao);
+                this->record_vertex_layout();
+                GLState::bind_vertex_array(0);
+            }
+            else
+            {
+                GL_COUNTED(glBindBuffer(GL_ARRAY_BUFFER, cbo));
+                GL_COUNTED(glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), count * sizeof(glm::vec3), colors.data() + first));
+            }
+            GL_COUNTED(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        }
+        if (dynamic_vertices)
+        {
+            dynamic_vertices->mark_dirty(first * sizeof(Vertex), count * sizeof(Vertex));
+            return;
+        }
+        GL_COUNTED(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+        GL_COUNTED(glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), vertices.data() + first));
+        GL_COUNTED(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+    /* Advances a dynamic mesh's ring once per frame, however many objects draw it */
+    void stream()
+    {
+        if (!dynamic_vertices || streamed_frame == GLState::get_frame()) { return; }
+        streamed_frame = GLState::get_frame();
+        dynamic_vertices->update(vertices.data());
+    }
+
+    ~Mesh()
+    {
+        /* Meshes that were never uploaded may be destroyed without a GL context */
+        if (!is_vao_init()) { return; }
+        if (!dynamic_vertices) { glDeleteBuffers(1, &vbo); }
+        glDeleteBuffers(1, &ibo);
+        glDeleteBuffers(1, &cbo);
+        GLState::forget_vertex_array(vao);
+        glDeleteVertexArrays(1, &vao);
+    }
+};
+
+/* Set on scene loader worker threads, which have no GL context: meshes are collected here instead of uploaded
+   and the render thread uploads them later */
+thread_local std::vector <std::shared_ptr <Mesh>>* deferred_uploads = nullptr;
+
+/* Identifies a generated mesh: generator name plus every parameter that ends up in the vertex data */
+struct MeshKey
+{
+    std::string generator;
+    std::vector <float> parameters;
+
+    bool operator <(const MeshKey& other) const
+    {
+        return generator != other.generator ? generator < other.generator : parameters < other.parameters;
+    }
+};
+
+struct MeshCacheStats
+{
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long bytes_saved = 0;
+    /* Misses served from, and generated meshes written to, the cache directory */
+    unsigned long long file_hits = 0;
+    unsigned long long file_writes = 0;
+};
+
+/* Read-only view of a whole file, memory-mapped where the platform allows it */
+class MappedFile
+{
+private:
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    std::vector <unsigned char> buffer;
+#endif
+public:
+    explicit MappedFile(const std::string& path)
+    {
+#ifndef _WIN32
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) { return; }
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, static_cast <std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED)
+            {
+                data = static_cast <const unsigned char*>(mapping);
+                size = static_cast <std::size_t>(info.st_size);
+            }
+        }
+        close(file);
+#else
+        std::ifstream stream(path, std::ios::binary);
+        buffer.assign(std::istreambuf_iterator <char>(stream), std::istreambuf_iterator <char>());
+        data = buffer.data();
+        size = buffer.size();
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    bool is_open() const { return data != nullptr; }
+    const unsigned char* get_data() const { return data; }
+    std::size_t get_size() const { return size; }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data) { munmap(const_cast <unsigned char*>(data), size); }
+#endif
+    }
+};
+
+/* Layout of a mesh cache file: this header, the key (generator name, then parameters), then the vertices
+   and the indices, each starting at a MESH_FILE_ALIGNMENT boundary so they can be uploaded in place */
+struct MeshFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    /* sizeof(Vertex) when written, files from builds with another vertex layout are ignored */
+    std::uint32_t vertex_size;
+    std::uint64_t vertex_count;
+    std::uint64_t index_count;
+    std::uint64_t vertex_offset;
+    std::uint64_t index_offset;
+    std::uint32_t generator_size;
+    std::uint32_t parameter_count;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+const char MESH_FILE_MAGIC[8] = { 'P', 'A', 'W', 'N', 'M', 'E', 'S', 'H' };
+/* Bump whenever the header or the generators change what they write */
+const std::uint32_t MESH_FILE_VERSION = 3;
+const std::size_t MESH_FILE_ALIGNMENT = 64;
+
+/* File name of a key inside the cache directory, an FNV-1a hash of the generator name and parameter bits */
+std::string mesh_file_name(const MeshKey& key)
+{
+    std::uint64_t hash = fnv1a(key.generator.data(), key.generator.size());
+    hash = fnv1a(key.parameters.data(), key.parameters.size() * sizeof(float), hash);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", static_cast <unsigned long long>(hash));
+    return name;
+}
+
+std::size_t align_mesh_file_offset(std::size_t offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+/* Writes through a temporary file and renames it, so a concurrent or interrupted run never sees half a file.
+   Meshes with per-vertex colors are not written */
+bool write_mesh_file(const std::string& path, const MeshKey& key, const Mesh& mesh)
+{
+    if (mesh.has_colors()) { return false; }
+    MeshFileHeader header = {};
+    std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+    header.version = MESH_FILE_VERSION;
+    header.vertex_size = sizeof(Vertex);
+    header.vertex_count = mesh.get_vertices().size();
+    header.index_count = mesh.get_indices().size();
+    header.generator_size = static_cast <std::uint32_t>(key.generator.size());
+    header.parameter_count = static_cast <std::uint32_t>(key.parameters.size());
+    for (int i = 0; i < 3; ++i)
+    {
+        header.bounds_min[i] = mesh.get_bounds().min[i];
+        header.bounds_max[i] = mesh.get_bounds().max[i];
+    }
+    std::size_t key_end = sizeof(header) + key.generator.size() + key.parameters.size() * sizeof(float);
+    header.vertex_offset = align_mesh_file_offset(key_end);
+    header.index_offset = align_mesh_file_offset(header.vertex_offset + header.vertex_count * sizeof(Vertex));
+
+    /* Per thread, scene loader workers may write the same key at once */
+    std::string temporary = path + "." + std::to_string(std::hash <std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if (!stream) { return false; }
+        const char padding[MESH_FILE_ALIGNMENT] = {};
+        stream.write(reinterpret_cast <const char*>(&header), sizeof(header));
+        stream.write(key.generator.data(), key.generator.size());
+        stream.write(reinterpret_cast <const char*>(key.parameters.data()), key.parameters.size() * sizeof(float));
+        stream.write(padding, header.vertex_offset - key_end);
+        stream.write(reinterpret_cast <const char*>(mesh.get_vertices().data()), header.vertex_count * sizeof(Vertex));
+        stream.write(padding, header.index_offset - (header.vertex_offset + header.vertex_count * sizeof(Vertex)));
+        stream.write(reinterpret_cast <const char*>(mesh.get_indices().data()), header.index_count * sizeof(unsigned int));
+        if (!stream) { return false; }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+/* Maps a cache file and uploads its vertices and indices directly from the mapping, or without upload copies them
+   into the mesh's CPU buffers. Returns nullptr when the file is missing, truncated, from another format version or for another key */
+std::shared_ptr <Mesh> read_mesh_file(const std::string& path, const MeshKey& key, bool upload = true)
+{
+    MappedFile file(path);
+    if (!file.is_open() || file.get_size() < sizeof(MeshFileHeader)) { return nullptr; }
+    MeshFileHeader header;
+    std::memcpy(&header, file.get_data(), sizeof(header));
+    if (std::memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_FILE_VERSION || 
+        header.vertex_size != sizeof(Vertex) || header.generator_size != key.generator.size() || 
+        header.parameter_count != key.parameters.size())
+    {
+        return nullptr;
+    }
+    const unsigned char* stored_key = file.get_data() + sizeof(header);
+    if (header.vertex_offset % MESH_FILE_ALIGNMENT != 0 || header.index_offset % MESH_FILE_ALIGNMENT != 0 || 
+        header.index_offset + header.index_count * sizeof(unsigned int) > file.get_size() || 
+        header.vertex_offset + header.vertex_count * sizeof(Vertex) > header.index_offset || 
+        sizeof(header) + key.generator.size() + key.parameters.size() * sizeof(float) > header.vertex_offset ||
+        std::memcmp(stored_key, key.generator.data(), key.generator.size()) != 0 || 
+        std::memcmp(stored_key + key.generator.size(), key.parameters.data(), key.parameters.size() * sizeof(float)) != 0)
+    {
+        return nullptr;
+    }
+
+    Bounds bounds;
+    bounds.expand(glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]));
+    bounds.expand(glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]));
+    std::shared_ptr <Mesh> mesh = std::make_shared <Mesh>();
+    const Vertex* vertices = reinterpret_cast <const Vertex*>(file.get_data() + header.vertex_offset);
+    const unsigned int* indices = reinterpret_cast <const unsigned int*>(file.get_data() + header.index_offset);
+    if (upload) { mesh->upload(vertices, header.vertex_count, indices, header.index_count, bounds); }
+    else
+    {
+        mesh->assign(std::vector <Vertex>(vertices, vertices + header.vertex_count), std::vector <unsigned int>(indices, indices + header.index_count));
+        mesh->set_bounds(bounds);
+    }
+    return mesh;
+}
+
+/* Reference-counted registry of generated meshes, a mesh lives as long as some Object3D holds it */
+class MeshCache
+{
+private:
+    /* The size is taken when the mesh is registered, before any other thread can see it: a shared mesh is only
+       touched by the render thread afterwards, which uploads it and may release its CPU copy */
+    struct Entry
+    {
+        std::weak_ptr <Mesh> mesh;
+        std::size_t byte_size = 0;
+    };
+    std::map <MeshKey, Entry> meshes;
+    MeshCacheStats stats;
+    /* Where generated meshes persist between runs, empty to keep the cache in memory only */
+    std::string directory;
+    /* Scene loader workers construct objects concurrently */
+    mutable std::mutex mutex;
+
+    std::string get_directory_locked() const
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        return directory;
+    }
+
+    MeshCache() = default;
+public:
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator =(const MeshCache&) = delete;
+
+    static MeshCache& instance()
+    {
+        static MeshCache cache;
+        return cache;
+    }
+
+    /* Returns the live mesh for the key, or nullptr when it has to be generated */
+    std::shared_ptr <Mesh> find(const MeshKey& key)
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        auto it = meshes.find(key);
+        std::shared_ptr <Mesh> mesh = it != meshes.end() ? it->second.mesh.lock() : nullptr;
+        if (mesh)
+        {
+            ++stats.hits;
+            stats.bytes_saved += it->second.byte_size;
+        }
+        else
+        {
+            ++stats.misses;
+        }
+        return mesh;
+    }
+    void insert(const MeshKey& key, const std::shared_ptr <Mesh>& mesh)
+    {
+        std::size_t byte_size = mesh->get_byte_size();
+        std::lock_guard <std::mutex> lock(mutex);
+        meshes[key] = { mesh, byte_size };
+        /* Forget meshes whose last owner is gone */
+        for (auto it = meshes.begin(); it != meshes.end();)
+        {
+            it = it->second.mesh.expired() ? meshes.erase(it) : std::next(it);
+        }
+    }
+
+    void set_directory(const std::string& directory)
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        this->directory = directory;
+    }
+    std::string get_directory() const { return get_directory_locked(); }
+
+    /* Loads a mesh written by an earlier run and registers it, or returns nullptr.
+       On threads with deferred uploads the mesh is copied out of the file and queued instead */
+    std::shared_ptr <Mesh> load(const MeshKey& key)
+    {
+        std::string directory = get_directory_locked();
+        if (directory.empty()) { return nullptr; }
+        std::shared_ptr <Mesh> mesh = read_mesh_file(directory + "/" + mesh_file_name(key), key, deferred_uploads == nullptr);
+        if (mesh)
+        {
+            std::size_t byte_size = mesh->get_byte_size();
+            if (deferred_uploads) { deferred_uploads->push_back(mesh); }
+            std::lock_guard <std::mutex> lock(mutex);
+            ++stats.file_hits;
+            meshes[key] = { mesh, byte_size };
+        }
+        return mesh;
+    }
+    /* Persists a freshly generated mesh, which must still have its CPU copy */
+    void store(const MeshKey& key, const Mesh& mesh)
+    {
+        std::string directory = get_directory_locked();
+        if (directory.empty() || !mesh.is_cpu_copy_kept()) { return; }
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        bool written = write_mesh_file(directory + "/" + mesh_file_name(key), key, mesh);
+        std::lock_guard <std::mutex> lock(mutex);
+        if (written) { ++stats.file_writes; }
+        else if (!this->directory.empty())
+        {
+            std::cout << "[MeshCache]: Could not write to " << directory << ", keeping meshes in memory only" << std::endl;
+            this->directory.clear();
+        }
+    }
+
+    MeshCacheStats get_stats() const
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        return stats;
+    }
+    std::size_t get_live_count() const
+    {
+        std::lock_guard <std::mutex> lock(mutex);
+        return std::count_if(meshes.begin(), meshes.end(), [](const auto& entry) { return !entry.second.mesh.expired(); });
+    }
+};
+
+/* Tessellations below this many vertices are generated on the calling thread, thread start-up would dominate */
+const std::size_t PARALLEL_TESSELLATION_VERTICES = 1 << 16;
+
+/* Splits [0, rows) into contiguous chunks processed by function(begin, end) on separate threads */
+template <class Function>
+void parallel_rows(unsigned int rows, std::size_t work, Function function)
+{
+    unsigned int threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), rows);
+    if (work < PARALLEL_TESSELLATION_VERTICES || threads <= 1)
+    {
+        function(0u, rows);
+        return;
+    }
+
+    unsigned int chunk = (rows + threads - 1) / threads;
+    std::vector <std::thread> workers;
+    for (unsigned int begin = chunk; begin < rows; begin += chunk)
+    {
+        workers.emplace_back(function, begin, std::min(rows, begin + chunk));
+    }
+    function(0u, std::min(rows, chunk));
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+/* Fills mesh with a (layer_quality + 1) x (density_quality + 1) vertex grid, seam and poles included, with exact normals.
+   Triangles wind counter-clockwise seen from outside, like every generated shape, so back faces can be culled.
+   Ring sines and cosines are evaluated once per row/column instead of per quad corner, and rows are
+   written in place into the pre-sized buffers, so large grids split cleanly across threads */
+void tessellate_sphere(Mesh& mesh, float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality)
+{
+    PAWN_CPU_SCOPE("tessellate_sphere");
+    const unsigned int row = density_quality + 1;
+
+    std::vector <float> cos_theta(layer_quality + 1), sin_theta(layer_quality + 1);
+    for (unsigned int i = 0; i <= layer_quality; ++i)
+    {
+        cos_theta[i] = r * cosf(2 * PI * i / static_cast <float>(layer_quality));
+        sin_theta[i] = r * sinf(2 * PI * i / static_cast <float>(layer_quality));
+    }
+    std::vector <float> sin_phi(row), z_phi(row);
+    for (unsigned int j = 0; j <= density_quality; ++j)
+    {
+        sin_phi[j] = sinf(j / static_cast <float>(density_quality) * PI);
+        z_phi[j] = z + r * cosf(j / static_cast <float>(density_quality) * PI);
+    }
+
+    mesh.resize(static_cast <std::size_t>(layer_quality + 1) * row, static_cast <std::size_t>(layer_quality) * density_quality * 6);
+    Bounds bounds;
+    bounds.expand(glm::vec3(x - r, y - r, z - r));
+    bounds.expand(glm::vec3(x + r, y + r, z + r));
+    mesh.set_bounds(bounds);
+    Vertex* vertices = mesh.vertex_data();
+    unsigned int* indices = mesh.index_data();
+
+    const glm::vec3 center(x, y, z);
+    const float inverse_r = r != 0.0f ? 1.0f / r : 0.0f;
+    parallel_rows(layer_quality + 1, mesh.get_vertex_count(), [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            Vertex* out = vertices + static_cast <std::size_t>(i) * row;
+            const float ct = cos_theta[i], st = sin_theta[i];
+            for (unsigned int j = 0; j < row; ++j)
+            {
+                out[j].position = glm::vec3(x + ct * sin_phi[j], y + st * sin_phi[j], z_phi[j]);
+                out[j].normal = (out[j].position - center) * inverse_r;
+            }
+
+            if (i == layer_quality) { continue; }
+            unsigned int* tri = indices + static_cast <std::size_t>(i) * density_quality * 6;
+            for (unsigned int j = 0; j < density_quality; ++j, tri += 6)
+            {
+                unsigned int v1 = i * row + j;
+                unsigned int v2 = (i + 1) * row + j;
+                tri[0] = v1; tri[1] = v1 + 1; tri[2] = v2;
+                tri[3] = v1 + 1; tri[4] = v2 + 1; tri[5] = v2;
+            }
+        }
+    });
+}
+
+/* Fills mesh with two fanned caps (ring of circle_quality + 1 vertices plus a center each) and a side
+   made of interleaved bottom/top vertex pairs, side_quality + 1 of them, stitched into quads. Caps and side
+   do not share vertices, so each gets its exact normal. Counter-clockwise seen from outside */
+void tessellate_standing_cylinder(Mesh& mesh, float bx, float by, float bz, float r, float h, unsigned int circle_quality, unsigned int side_quality)
+{
+    PAWN_CPU_SCOPE("tessellate_cylinder");
+    std::vector <float> cap_x(circle_quality + 1), cap_z(circle_quality + 1);
+    for (unsigned int i = 0; i <= circle_quality; ++i)
+    {
+        cap_x[i] = bx + r * cosf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
+        cap_z[i] = bz + r * sinf(2.0f * PI * static_cast <float>(i) / static_cast <float>(circle_quality));
+    }
+
+    const std::size_t cap_vertices = circle_quality + 2;
+    mesh.resize(2 * cap_vertices + 2 * static_cast <std::size_t>(side_quality + 1), 6 * static_cast <std::size_t>(circle_quality + side_quality));
+    Bounds bounds;
+    bounds.expand(glm::vec3(bx - r, by, bz - r));
+    bounds.expand(glm::vec3(bx + r, by + h, bz + r));
+    mesh.set_bounds(bounds);
+    Vertex* vertices = mesh.vertex_data();
+    unsigned int* tri = mesh.index_data();
+
+    for (unsigned int cap = 0; cap < 2; ++cap)
+    {
+        const float cap_y = cap == 0 ? by : by + h;
+        const glm::vec3 normal(0.0f, cap == 0 ? -1.0f : 1.0f, 0.0f);
+        const unsigned int first = static_cast <unsigned int>(cap * cap_vertices);
+        const unsigned int center = first + circle_quality + 1;
+        Vertex* out = vertices + first;
+        for (unsigned int i = 0; i <= circle_quality; ++i)
+        {
+            out[i].position = glm::vec3(cap_x[i], cap_y, cap_z[i]);
+            out[i].normal = normal;
+        }
+        out[circle_quality + 1].position = glm::vec3(bx, cap_y, bz);
+        out[circle_quality + 1].normal = normal;
+        /* The ring runs counter-clockwise seen from below, so the top cap takes it backwards */
+        for (unsigned int i = 0; i < circle_quality; ++i, tri += 3)
+        {
+            tri[0] = first + i + cap; tri[1] = first + i + 1 - cap; tri[2] = center;
+        }
+    }
+
+    const unsigned int side = static_cast <unsigned int>(2 * cap_vertices);
+    Vertex* out = vertices + side;
+    for (unsigned int i = 0; i <= side_quality; ++i)
+    {
+        float nx = cosf(2 * PI * static_cast <float>(i) / static_cast <float>(side_quality));
+        float nz = sinf(2 * PI * static_cast <float>(i) / static_cast <float>(side_quality));
+        float x = bx + r * nx, z = bz + r * nz;
+        out[2 * i].position = glm::vec3(x, by, z);
+        out[2 * i + 1].position = glm::vec3(x, by + h, z);
+        out[2 * i].normal = out[2 * i + 1].normal = glm::vec3(nx, 0.0f, nz);
+    }
+    for (unsigned int i = 0; i < side_quality; ++i, tri += 6)
+    {
+        unsigned int b = side + 2 * i, bnext = side + 2 * (i + 1);
+        unsigned int t = b + 1, tnext = bnext + 1;
+        tri[0] = b; tri[1] = t; tri[2] = bnext;
+        tri[3] = bnext; tri[4] = t; tri[5] = tnext;
+    }
+}
+
+/* Number of detail levels generated per procedural shape, each halving the tessellation quality of the previous */
+const unsigned int LOD_LEVELS = 3;
+
+/* Quality of a shape at a detail level, never reduced below minimum */
+unsigned int lod_quality(unsigned int quality, unsigned int level, unsigned int minimum)
+{
+    return std::max(quality >> level, std::min(quality, minimum));
+}
+
+class Object3D
+{
+private:
+    /* Shared with every copy and every identically parameterised object, copying an Object3D is a handle copy.
+       mesh is the current detail level, the one drawn and edited */
+    std::shared_ptr <Mesh> mesh = std::make_shared <Mesh>();
+    MeshKey mesh_key;
+    /* Detail levels from finest to coarsest, empty for objects without a LOD chain */
+    std::vector <std::shared_ptr <Mesh>> lods;
+    unsigned int lod = 0;
+    /* Per object, so objects sharing a mesh can differ in color */
+    Material material;
+protected:
+    /* Shares a cached mesh when one was built from the same key and returns true; otherwise starts
+       an empty mesh that init_vao() will publish under the key */
+    bool acquire_mesh(const MeshKey& key)
+    {
+        if (std::shared_ptr <Mesh> cached = MeshCache::instance().find(key))
+        {
+            mesh = cached;
+            return true;
+        }
+        if (std::shared_ptr <Mesh> loaded = MeshCache::instance().load(key))
+        {
+            mesh = loaded;
+            return true;
+        }
+        mesh = std::make_shared <Mesh>();
+        mesh_key = key;
+        return false;
+    }
+    /* Appends the current mesh as the next coarser detail level */
+    void push_lod() { lods.push_back(mesh); }
+public:
+    Object3D() = default;
+    Object3D(const Object3D& other) = default;
+    Object3D& operator =(const Object3D& other) = default;
+
+    const std::shared_ptr <Mesh>& get_mesh() const { return mesh; }
+    const Material& get_material() const { return material; }
+    void set_material(const Material& material) { this->material = material; }
+
+    std::size_t get_lod_count() const { return std::max <std::size_t>(lods.size(), 1); }
+    const std::shared_ptr <Mesh>& get_lod_mesh(unsigned int level) const { return lods.empty() ? mesh : lods[std::min <std::size_t>(level, lods.size() - 1)]; }
+    unsigned int get_lod() const { return lod; }
+    void set_lod(unsigned int level)
+    {
+        if (lods.empty()) { return; }
+        lod = std::min(level, static_cast <unsigned int>(lods.size() - 1));
+        mesh = lods[lod];
+    }
+    /* Object-space box, computed when the mesh was generated */
+    const Bounds& get_bounds() const { return mesh->get_bounds(); }
+
+    const std::vector <Vertex>& get_vertices() const { return mesh->get_vertices(); }
+    const std::vector <unsigned int>& get_indices() const { return mesh->get_indices(); }
+    std::size_t get_vertex_count() const { return mesh->get_vertex_count(); }
+    std::size_t get_index_count() const { return mesh->get_index_count(); }
+
+    unsigned int get_vao() const { return mesh->get_vao(); };
+    unsigned int get_vbo() const { return mesh->get_vbo(); };
+    unsigned int get_ibo() const { return mesh->get_ibo(); };
+
+    /* Mutators edit the mesh seen by every sharer, call init_vao() afterwards to re-upload it */
+    unsigned int push_vertex(float x, float y, float z) { return mesh->push_vertex(x, y, z); }
+    void push_triangle(unsigned int a, unsigned int b, unsigned int c) { mesh->push_triangle(a, b, c); }
+    void set_color(unsigned int index, float r, float g, float b) { mesh->set_color(index, r, g, b); }
+    void set_normal(unsigned int index, float x, float y, float z) { mesh->set_normal(index, x, y, z); }
+    void apply_normals(const std::vector <float>& normals) { mesh->apply_normals(normals); }
+    /* For objects whose vertices change after upload, see Mesh::make_dynamic(). Edit through set_color / set_normal,
+       then mark the edited range. The mesh may be shared, edits show on every object drawing it */
+    void make_dynamic() { mesh->make_dynamic(); }
+    void mark_vertices_dirty(std::size_t first, std::size_t count) { mesh->mark_vertices_dirty(first, count); }
+
+    /* Closed and wound counter-clockwise from outside, so back faces can be culled */
+    virtual bool is_closed() const { return false; }
+
+    bool is_vao_init() const { return mesh->is_vao_init(); }
+    bool is_vbo_init() const { return mesh->is_vbo_init(); }
+    bool is_ibo_init() const { return mesh->is_ibo_init(); }
+    bool is_entirely_init() const { return mesh->is_entirely_init(); }
+
+    void init_vao()
+    {
+        if (deferred_uploads)
+        {
+            mesh->compute_bounds();
+            deferred_uploads->push_back(mesh);
+        }
+        else { mesh->upload(); }
+        if (!mesh_key.generator.empty())
+        {
+            MeshCache::instance().insert(mesh_key, mesh);
+            MeshCache::instance().store(mesh_key, *mesh);
+        }
+    }
+    /* Replaces the mesh data without copying it, the object stops sharing its previous mesh */
+    void init_vao(std::vector <Vertex>&& vertices, std::vector <unsigned int>&& indices)
+    {
+        mesh = std::make_shared <Mesh>();
+        mesh_key = MeshKey();
+        lods.clear();
+        lod = 0;
+        if (deferred_uploads)
+        {
+            mesh->assign(std::move(vertices), std::move(indices));
+            mesh->compute_bounds();
+            deferred_uploads->push_back(mesh);
+        }
+        else { mesh->upload(std::move(vertices), std::move(indices)); }
+    }
+    void release_cpu_copy()
+    {
+        mesh->release_cpu_copy();
+        for (const auto& level : lods) { level->release_cpu_copy(); }
+    }
+    void record_vertex_layout() const { mesh->record_vertex_layout(); }
+
+    virtual ~Object3D() = default;
+};
+
+class Sphere : public Object3D, public Rotatable
+{
+private:
+    float x, y, z, r;
+public:
+    Sphere(float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality, 
+        std::vector <float> normalized_rgb, std::vector <float> normals) : Object3D(), Rotatable(), x(x), y(y), z(z), r(r)
+    { 
+        /* Caller-supplied normals only fit the full-quality vertex layout, so such spheres get no coarser levels */
+        unsigned int levels = normals != NULL_FLOAT_VECTOR ? 1 : LOD_LEVELS;
+        for (unsigned int level = 0; level < levels; ++level)
+        {
+            unsigned int layers = lod_quality(layer_quality, level, 3), density = lod_quality(density_quality, level, 2);
+            if (level > 0 && layers == lod_quality(layer_quality, level - 1, 3) && density == lod_quality(density_quality, level - 1, 2)) { break; }
+
+            /* Colors live in the material, so spheres of any color share the mesh */
+            MeshKey key = { "sphere", { x, y, z, r, static_cast <float>(layers), static_cast <float>(density) } };
+            key.parameters.insert(key.parameters.end(), normals.begin(), normals.end());
+            if (!this->acquire_mesh(key))
+            {
+                this->generate_sphere(this->x, this->y, this->z, this->r, layers, density);
+                if (normals != NULL_FLOAT_VECTOR) { this->apply_normals(normals); }
+                this->init_vao();
+            }
+            this->push_lod();
+        }
+        this->set_lod(0);
+        if (normalized_rgb != NULL_FLOAT_VECTOR) { this->apply_colors(normalized_rgb); }
+    }
+    void generate_sphere(float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality)
+    {
+        tessellate_sphere(*this->get_mesh(), x, y, z, r, layer_quality, density_quality);
+    }
+    void apply_colors(std::vector <float> normalized_rgb)
+    {
+        this->set_material(Material::make_gradient(normalized_rgb));
+    }
+    bool is_closed() const override { return true; }
+
+    void random_pure_virtual_function() override { return; }
+};
+
+class StandingCylinder : public Object3D, public Rotatable
+{
+private:
+    float bottom_x, bottom_y, bottom_z;
+    float r, h;
+public:
+    StandingCylinder(float x, float y, float z, float r, float h, unsigned int circle_quality, unsigned int side_quality,
+        std::vector <float> normalized_rgb, std::vector <float> normals) : Object3D(), Rotatable(), bottom_x(x), bottom_y(y), bottom_z(z), r(r), h(h)
+    {
+        /* Caller-supplied normals only fit the full-quality vertex layout, so such cylinders get no coarser levels */
+        unsigned int levels = normals != NULL_FLOAT_VECTOR ? 1 : LOD_LEVELS;
+        for (unsigned int level = 0; level < levels; ++level)
+        {
+            unsigned int circle = lod_quality(circle_quality, level, 3), side = lod_quality(side_quality, level, 3);
+            if (level > 0 && circle == lod_quality(circle_quality, level - 1, 3) && side == lod_quality(side_quality, level - 1, 3)) { break; }
+
+            MeshKey key = { "standing_cylinder", { x, y, z, r, h, static_cast <float>(circle), static_cast <float>(side) } };
+            key.parameters.insert(key.parameters.end(), normals.begin(), normals.end());
+            if (!this->acquire_mesh(key))
+            {
+                generate_cylinder(x, y, z, r, h, circle, side);
+                if (normals != NULL_FLOAT_VECTOR) { this->apply_normals(normals); }
+                this->init_vao();
+            }
+            this->push_lod();
+        }
+        this->set_lod(0);
+        if (normalized_rgb != NULL_FLOAT_VECTOR) { apply_color(normalized_rgb); }
+    }
+
+    void apply_color(std::vector <float> normalized_rgb)
+    {
+        this->set_material(Material::make_gradient(normalized_rgb));
+    }
+    void generate_cylinder(float bx, float by, float bz, float r, float h, unsigned int circle_quality, unsigned int side_quality)
+    {
+        tessellate_standing_cylinder(*this->get_mesh(), bx, by, bz, r, h, circle_quality, side_quality);
+    }
+    bool is_closed() const override { return true; }
+
+    void random_pure_virtual_function() override { return; }
+};
+
+/* Reads a file through one fixed-size window, so parsing memory does not grow with the file size.
+   Lines longer than the window grow it to the longest line */
+class StreamReader
+{
+private:
+    static const std::size_t CHUNK_SIZE = 1 << 20;
+    std::FILE* file = nullptr;
+    std::vector <char> buffer;
+    std::size_t begin = 0, end = 0;
+    unsigned long long bytes_read = 0, file_size = 0;
+    bool at_eof = false;
+
+    /* Moves the unread bytes to the front and tops the window up from the file */
+    void refill()
+    {
+        if (begin > 0)
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size()) { buffer.resize(buffer.size() * 2); }
+        std::size_t count = std::fread(buffer.data() + end, 1, buffer.size() - end, file);
+        if (count == 0) { at_eof = true; }
+        end += count;
+        bytes_read += count;
+    }
+public:
+    explicit StreamReader(const std::string& path) : file(std::fopen(path.c_str(), "rb")), buffer(CHUNK_SIZE)
+    {
+        std::error_code error;
+        file_size = std::filesystem::file_size(path, error);
+        if (error) { file_size = 0; }
+    }
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator =(const StreamReader&) = delete;
+
+    bool is_open() const { return file != nullptr; }
+    unsigned long long get_bytes_read() const { return bytes_read; }
+    /* Bytes between the read position and the end of the file */
+    unsigned long long get_bytes_left() const
+    {
+        unsigned long long position = bytes_read - (end - begin);
+        return file_size > position ? file_size - position : 0;
+    }
+
+    /* Points [line, line_end) at the next line without its terminator, valid until the next call */
+    bool next_line(const char*& line, const char*& line_end)
+    {
+        while (true)
+        {
+            const char* first = buffer.data() + begin;
+            const char* newline = static_cast <const char*>(std::memchr(first, '\n', end - begin));
+            if (newline || (at_eof && begin < end))
+            {
+                line = first;
+                line_end = newline ? newline : buffer.data() + end;
+                begin = newline ? newline - buffer.data() + 1 : end;
+                if (line_end > line && line_end[-1] == '\r') { --line_end; }
+                return true;
+            }
+            if (at_eof) { return false; }
+            refill();
+        }
+    }
+    /* Copies the next size bytes, returns false if the file ends first */
+    bool read(void* out, std::size_t size)
+    {
+        char* destination = static_cast <char*>(out);
+        while (size > 0)
+        {
+            if (begin == end)
+            {
+                if (at_eof) { return false; }
+                refill();
+                continue;
+            }
+            std::size_t count = std::min(size, end - begin);
+            std::memcpy(destination, buffer.data() + begin, count);
+            begin += count;
+            destination += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    ~StreamReader()
+    {
+        if (file) { std::fclose(file); }
+    }
+};
+
+/* Locale-independent number parsing for the ASCII formats. Both skip leading blanks, advance p past the number
+   and return false when there is none */
+bool parse_float(const char*& p, const char* end, float& value)
+{
+    static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) { ++p; }
+
+    /* Digits past the 19th cannot change a float, they only shift the exponent */
+    std::uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+    {
+        if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); }
+        else { ++exponent; }
+    }
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (digits == 0) { return false; }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negative_exponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) { ++p; }
+        int written = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) { written = std::min(written * 10 + (*p - '0'), 10000); }
+        exponent += negative_exponent ? -written : written;
+    }
+
+    double result = static_cast <double>(mantissa);
+    if (exponent >= 0) { result *= exponent <= 22 ? POWERS_OF_TEN[exponent] : std::pow(10.0, exponent); }
+    else { result /= -exponent <= 22 ? POWERS_OF_TEN[-exponent] : std::pow(10.0, -exponent); }
+    value = static_cast <float>(negative ? -result : result);
+    return true;
+}
+bool parse_int(const char*& p, const char* end, long long& value)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) { ++p; }
+    if (p == end || *p < '0' || *p > '9') { return false; }
+    long long result = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) { result = result * 10 + (*p - '0'); }
+    value = negative ? -result : result;
+    return true;
+}
+/* The next run of non-blank characters */
+bool parse_word(const char*& p, const char* end, std::string& word)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+    const char* begin = p;
+    while (p < end && *p != ' ' && *p != '\t') { ++p; }
+    word.assign(begin, p);
+    return p != begin;
+}
+
+/* Indexed geometry produced by the importers */
+struct ImportedMesh
+{
+    std::vector <Vertex> vertices;
+    std::vector <unsigned int> indices;
+    /* One per vertex when has_colors, otherwise empty */
+    std::vector <glm::vec3> colors;
+    bool has_colors = false;
+    bool has_normals = false;
+    unsigned long long bytes_read = 0;
+};
+
+/* Wavefront OBJ: v (with optional rgb), vn and f records, faces of any size are fanned into triangles and
+   position/normal pairs are deduplicated into one vertex each. Everything else is skipped */
+bool import_obj(const std::string& path, ImportedMesh& mesh)
+{
+    PAWN_CPU_SCOPE("import_obj");
+    StreamReader reader(path);
+    if (!reader.is_open())
+    {
+        std::cout << "[Import]: Could not open " << path << std::endl;
+        return false;
+    }
+    std::vector <glm::vec3> positions, colors, normals;
+    std::unordered_map <std::uint64_t, unsigned int> unique_vertices;
+    std::vector <unsigned int> face;
+    unsigned long long line_number = 0;
+    const char* line;
+    const char* line_end;
+
+    auto fail = [&](const char* what)
+    {
+        std::cout << "[Import]: " << path << ":" << line_number << ": " << what << std::endl;
+        return false;
+    };
+    /* OBJ indices are 1-based, negative ones count back from the last element read */
+    auto resolve = [](long long index, std::size_t count) -> long long
+    {
+        long long resolved = index < 0 ? static_cast <long long>(count) + index : index - 1;
+        return resolved >= 0 && resolved < static_cast <long long>(count) ? resolved : -1;
+    };
+
+    while (reader.next_line(line, line_end))
+    {
+        ++line_number;
+        const char* p = line;
+        while (p < line_end && (*p == ' ' || *p == '\t')) { ++p; }
+        if (line_end - p < 2 || p[0] == '#') { continue; }
+
+        if (p[0] == 'v' && p[1] == ' ')
+        {
+            p += 2;
+            glm::vec3 position, color(1.0f);
+            if (!parse_float(p, line_end, position.x) || !parse_float(p, line_end, position.y) || !parse_float(p, line_end, position.z))
+            {
+                return fail("malformed vertex");
+            }
+            if (parse_float(p, line_end, color.x) && parse_float(p, line_end, color.y) && parse_float(p, line_end, color.z)) { mesh.has_colors = true; }
+            else { color = glm::vec3(1.0f); }
+            positions.push_back(position);
+            colors.push_back(color);
+        }
+        else if (p[0] == 'v' && p[1] == 'n')
+        {
+            p += 2;
+            glm::vec3 normal;
+            if (!parse_float(p, line_end, normal.x) || !parse_float(p, line_end, normal.y) || !parse_float(p, line_end, normal.z))
+            {
+                return fail("malformed normal");
+            }
+            normals.push_back(normal);
+        }
+        else if (p[0] == 'f' && p[1] == ' ')
+        {
+            ++p;
+            face.clear();
+            long long position_index, index;
+            while (parse_int(p, line_end, position_index))
+            {
+                long long normal_index = -1;
+                /* v, v/vt, v//vn or v/vt/vn, texture coordinates are not kept */
+                if (p < line_end && *p == '/')
+                {
+                    ++p;
+                    if (p < line_end && *p != '/' && !parse_int(p, line_end, index)) { return fail("malformed face"); }
+                    if (p < line_end && *p == '/')
+                    {
+                        ++p;
+                        if (!parse_int(p, line_end, index)) { return fail("malformed face"); }
+                        if ((normal_index = resolve(index, normals.size())) < 0) { return fail("normal index out of range"); }
+                    }
+                }
+                if ((position_index = resolve(position_index, positions.size())) < 0) { return fail("vertex index out of range"); }
+
+                std::uint64_t key = static_cast <std::uint64_t>(position_index) << 32 | static_cast <std::uint64_t>(normal_index + 1);
+                auto inserted = unique_vertices.insert({ key, static_cast <unsigned int>(mesh.vertices.size()) });
+                if (inserted.second)
+                {
+                    if (mesh.vertices.size() == std::numeric_limits <unsigned int>::max()) { return fail("too many vertices"); }
+                    Vertex vertex;
+                    vertex.position = positions[position_index];
+                    if (normal_index >= 0) { vertex.normal = normals[normal_index]; }
+                    mesh.vertices.push_back(vertex);
+                    mesh.colors.push_back(colors[position_index]);
+                }
+                face.push_back(inserted.first->second);
+            }
+            if (!normals.empty()) { mesh.has_normals = true; }
+            for (std::size_t i = 2; i < face.size(); ++i)
+            {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+    }
+    /* Colors are only known to be present once some v record had them */
+    if (!mesh.has_colors) { std::vector <glm::vec3>().swap(mesh.colors); }
+    mesh.bytes_read = reader.get_bytes_read();
+    return true;
+}
+
+enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, INVALID };
+
+PlyType parse_ply_type(const std::string& name)
+{
+    if (name == "char" || name == "int8") { return PlyType::INT8; }
+    if (name == "uchar" || name == "uint8") { return PlyType::UINT8; }
+    if (name == "short" || name == "int16") { return PlyType::INT16; }
+    if (name == "ushort" || name == "uint16") { return PlyType::UINT16; }
+    if (name == "int" || name == "int32") { return PlyType::INT32; }
+    if (name == "uint" || name == "uint32") { return PlyType::UINT32; }
+    if (name == "float" || name == "float32") { return PlyType::FLOAT32; }
+    if (name == "double" || name == "float64") { return PlyType::FLOAT64; }
+    return PlyType::INVALID;
+}
+std::size_t ply_type_size(PlyType type)
+{
+    switch (type)
+    {
+    case PlyType::INT8: case PlyType::UINT8: return 1;
+    case PlyType::INT16: case PlyType::UINT16: return 2;
+    case PlyType::INT32: case PlyType::UINT32: case PlyType::FLOAT32: return 4;
+    case PlyType::FLOAT64: return 8;
+    default: return 0;
+    }
+}
+/* Decodes one value, swapping bytes when the file's endianness differs from the host's */
+double read_ply_value(const unsigned char* data, PlyType type, bool swap)
+{
+    unsigned char swapped[8];
+    std::size_t size = ply_type_size(type);
+    const unsigned char* bytes = data;
+    if (swap)
+    {
+        for (std::size_t i = 0; i < size; ++i) { swapped[i] = data[size - 1 - i]; }
+        bytes = swapped;
+    }
+    switch (type)
+    {
+    case PlyType::INT8: { std::int8_t v; std::memcpy(&v, bytes, 1); return v; }
+    case PlyType::UINT8: { std::uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+    case PlyType::INT16: { std::int16_t v; std::memcpy(&v, bytes, 2); return v; }
+    case PlyType::UINT16: { std::uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+    case PlyType::INT32: { std::int32_t v; std::memcpy(&v, bytes, 4); return v; }
+    case PlyType::UINT32: { std::uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+    case PlyType::FLOAT32: { float v; std::memcpy(&v, bytes, 4); return v; }
+    case PlyType::FLOAT64: { double v; std::memcpy(&v, bytes, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type = PlyType::INVALID;
+    /* Lists store their length as count_type followed by that many values of type */
+    bool is_list = false;
+    PlyType count_type = PlyType::INVALID;
+};
+struct PlyElement
+{
+    std::string name;
+    unsigned long long count = 0;
+    std::vector <PlyProperty> properties;
+};
+
+/* Binary PLY, either endianness: vertex x/y/z with optional nx/ny/nz and red/green/blue, faces as index lists
+   fanned into triangles. PLY vertices are already shared between faces, so they are taken as they are.
+   Other elements are skipped */
+bool import_ply(const std::string& path, ImportedMesh& mesh)
+{
+    PAWN_CPU_SCOPE("import_ply");
+    StreamReader reader(path);
+    if (!reader.is_open())
+    {
+        std::cout << "[Import]: Could not open " << path << std::endl;
+        return false;
+    }
+    auto fail = [&path](const char* what)
+    {
+        std::cout << "[Import]: " << path << ": " << what << std::endl;
+        return false;
+    };
+
+    const char* line;
+    const char* line_end;
+    if (!reader.next_line(line, line_end) || std::string(line, line_end) != "ply") { return fail("not a PLY file"); }
+    std::vector <PlyElement> elements;
+    bool little_endian = true, header_done = false;
+    std::string keyword, word;
+    while (!header_done && reader.next_line(line, line_end))
+    {
+        const char* p = line;
+        if (!parse_word(p, line_end, keyword)) { continue; }
+        if (keyword == "format")
+        {
+            float version;
+            if (!parse_word(p, line_end, word) || !parse_float(p, line_end, version)) { return fail("malformed format"); }
+            if (word == "ascii") { return fail("ASCII PLY is not supported, convert it to binary"); }
+            if (word != "binary_little_endian" && word != "binary_big_endian") { return fail("unknown format"); }
+            little_endian = word == "binary_little_endian";
+        }
+        else if (keyword == "element")
+        {
+            long long count;
+            if (!parse_word(p, line_end, word) || !parse_int(p, line_end, count) || count < 0) { return fail("malformed element"); }
+            elements.emplace_back();
+            elements.back().name = word;
+            elements.back().count = static_cast <unsigned long long>(count);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            if (!parse_word(p, line_end, word)) { return fail("malformed property"); }
+            if (word == "list")
+            {
+                property.is_list = true;
+                if (!parse_word(p, line_end, word)) { return fail("malformed property"); }
+                property.count_type = parse_ply_type(word);
+                if (property.count_type == PlyType::INVALID) { return fail("unknown property type"); }
+                if (!parse_word(p, line_end, word)) { return fail("malformed property"); }
+            }
+            property.type = parse_ply_type(word);
+            if (property.type == PlyType::INVALID) { return fail("unknown property type"); }
+            if (!parse_word(p, line_end, property.name)) { return fail("malformed property"); }
+            elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header") { header_done = true; }
+    }
+    if (!header_done) { return fail("truncated header"); }
+
+    const std::uint16_t probe = 1;
+    const bool host_little_endian = *reinterpret_cast <const unsigned char*>(&probe) == 1;
+    const bool swap = little_endian != host_little_endian;
+    unsigned long long vertex_base = 0;
+    std::vector <unsigned char> record;
+    std::vector <unsigned int> face;
+
+    for (const PlyElement& element : elements)
+    {
+        /* Smallest record, lists counted empty. A count the rest of the file cannot hold is malformed and must not
+           reach reserve() */
+        std::size_t min_record_size = 0;
+        for (const PlyProperty& property : element.properties) { min_record_size += ply_type_size(property.is_list ? property.count_type : property.type); }
+        if (min_record_size == 0) { continue; }
+        if (element.count > reader.get_bytes_left() / min_record_size) { return fail("element count larger than the file"); }
+
+        bool fixed_size = std::none_of(element.properties.begin(), element.properties.end(), [](const PlyProperty& p) { return p.is_list; });
+        if (element.name == "vertex" && fixed_size)
+        {
+            /* Offset of each property inside a record, -1 when the file does not have it */
+            const char* NAMES[] = { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" };
+            long long offsets[9];
+            PlyType types[9];
+            std::fill(offsets, offsets + 9, -1);
+            std::size_t record_size = 0;
+            for (const PlyProperty& property : element.properties)
+            {
+                for (int i = 0; i < 9; ++i)
+                {
+                    if (property.name == NAMES[i])
+                    {
+                        offsets[i] = static_cast <long long>(record_size);
+                        types[i] = property.type;
+                    }
+                }
+                record_size += ply_type_size(property.type);
+            }
+            if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0) { return fail("vertices without x, y, z"); }
+            if (vertex_base + element.count > std::numeric_limits <unsigned int>::max()) { return fail("too many vertices"); }
+            mesh.has_normals = offsets[3] >= 0 && offsets[4] >= 0 && offsets[5] >= 0;
+            mesh.has_colors = offsets[6] >= 0 && offsets[7] >= 0 && offsets[8] >= 0;
+            /* Integer colors are 0-255, floating point ones already normalized */
+            const double color_scale = mesh.has_colors && types[6] != PlyType::FLOAT32 && types[6] != PlyType::FLOAT64 ? 1.0 / 255.0 : 1.0;
+
+            mesh.vertices.reserve(mesh.vertices.size() + element.count);
+            if (mesh.has_colors) { mesh.colors.reserve(mesh.vertices.size() + element.count); }
+            record.resize(record_size);
+            for (unsigned long long i = 0; i < element.count; ++i)
+            {
+                if (!reader.read(record.data(), record_size)) { return fail("truncated vertex data"); }
+                auto value = [&](int property) { return static_cast <float>(read_ply_value(record.data() + offsets[property], types[property], swap)); };
+                Vertex vertex;
+                vertex.position = glm::vec3(value(0), value(1), value(2));
+                if (mesh.has_normals) { vertex.normal = glm::vec3(value(3), value(4), value(5)); }
+                if (mesh.has_colors) { mesh.colors.push_back(glm::vec3(value(6), value(7), value(8)) * static_cast <float>(color_scale)); }
+                mesh.vertices.push_back(vertex);
+            }
+            vertex_base += element.count;
+            continue;
+        }
+
+        bool is_face = element.name == "face";
+        for (unsigned long long i = 0; i < element.count; ++i)
+        {
+            face.clear();
+            for (const PlyProperty& property : element.properties)
+            {
+                unsigned char value[8];
+                if (!property.is_list)
+                {
+                    if (!reader.read(value, ply_type_size(property.type))) { return fail("truncated element data"); }
+                    continue;
+                }
+                if (!reader.read(value, ply_type_size(property.count_type))) { return fail("truncated element data"); }
+                unsigned long long count = static_cast <unsigned long long>(read_ply_value(value, property.count_type, swap));
+                bool is_indices = is_face && (property.name == "vertex_indices" || property.name == "vertex_index");
+                for (unsigned long long j = 0; j < count; ++j)
+                {
+                    if (!reader.read(value, ply_type_size(property.type))) { return fail("truncated element data"); }
+                    if (!is_indices) { continue; }
+                    double index = read_ply_value(value, property.type, swap);
+                    if (index < 0 || index >= static_cast <double>(mesh.vertices.size())) { return fail("vertex index out of range"); }
+                    face.push_back(static_cast <unsigned int>(index));
+                }
+            }
+            for (std::size_t j = 2; j < face.size(); ++j)
+            {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[j - 1]);
+                mesh.indices.push_back(face[j]);
+            }
+        }
+    }
+    mesh.bytes_read = reader.get_bytes_read();
+    return true;
+}
+
+/* Geometry loaded from a .obj or binary .ply file. Files without vertex colors are shaded with the same gradient
+   as the procedural shapes when normalized_rgb is given, white otherwise */
+class MeshObject : public Object3D, public Rotatable
+{
+private:
+    std::string path;
+    bool loaded = false;
+    bool closed = false;
+public:
+    /* Imported files are often open or inconsistently wound, closed opts in to back-face culling */
+    MeshObject(const std::string& path, std::vector <float> normalized_rgb = NULL_FLOAT_VECTOR, bool closed = false) 
+        : Object3D(), Rotatable(), path(path), closed(closed)
+    {
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast <char>(std::tolower(c)); });
+        ImportedMesh imported;
+        if (extension == ".obj") { loaded = import_obj(path, imported); }
+        else if (extension == ".ply") { loaded = import_ply(path, imported); }
+        else { std::cout << "[Import]: Unsupported file type " << path << std::endl; }
+        if (!loaded)
+        {
+            imported = ImportedMesh();
+        }
+
+        this->get_mesh()->assign(std::move(imported.vertices), std::move(imported.indices));
+        if (imported.has_colors) { this->get_mesh()->assign_colors(std::move(imported.colors)); }
+        else if (loaded && normalized_rgb != NULL_FLOAT_VECTOR) { this->set_material(Material::make_gradient(normalized_rgb)); }
+        this->init_vao();
+    }
+
+    bool is_loaded() const { return loaded; }
+    const std::string& get_path() const { return path; }
+    bool is_closed() const override { return closed && loaded; }
+
+    void random_pure_virtual_function() override { return; }
+};
+
+/* Uniform buffer binding point of the Transforms block in pawn.shader */
+const unsigned int TRANSFORM_BLOCK_BINDING = 0;
+
+/* Per-object position / rotation / scale kept in contiguous arrays. World matrices are recomputed from the
+   elapsed time in one batched pass, so animation speed does not depend on frame rate and no error accumulates,
+   and all of them reach the GPU with a single uniform buffer upload per frame */
+class TransformSystem
+{
+public:
+    /* mat4s per bound range of the Transforms block: 16 KB, the minimum GL_MAX_UNIFORM_BLOCK_SIZE */
+    static const unsigned int BLOCK_CAPACITY = 256;
+private:
+    std::vector <glm::vec3> positions;
+    std::vector <glm::vec3> rotation_axes;
+    std::vector <float> angular_speeds;
+    std::vector <glm::vec3> scales;
+    std::vector <glm::mat4> world;
+    /* Whole blocks per section, so every bound range lies inside it and is suitably aligned */
+    DynamicBuffer ubo{ GL_UNIFORM_BUFFER, BLOCK_CAPACITY * sizeof(glm::mat4) };
+public:
+    TransformSystem() = default;
+    TransformSystem(const TransformSystem&) = delete;
+    TransformSystem& operator =(const TransformSystem&) = delete;
+
+    /* angular_speed is in radians per second around rotation_axis */
+    std::size_t add(const glm::vec3& rotation_axis, float angular_speed, const glm::vec3& position = glm::vec3(0.0f), 
+        const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        positions.push_back(position);
+        rotation_axes.push_back(rotation_axis);
+        angular_speeds.push_back(angular_speed);
+        scales.push_back(scale);
+        world.push_back(glm::mat4(1));
+        return world.size() - 1;
+    }
+    std::size_t size() const { return world.size(); }
+    const glm::mat4& get_world(std::size_t index) const { return world[index]; }
+
+    const glm::vec3& get_position(std::size_t index) const { return positions[index]; }
+    const glm::vec3& get_rotation_axis(std::size_t index) const { return rotation_axes[index]; }
+    float get_angular_speed(std::size_t index) const { return angular_speeds[index]; }
+    const glm::vec3& get_scale(std::size_t index) const { return scales[index]; }
+
+    void set_position(std::size_t index, const glm::vec3& position) { positions[index] = position; }
+    void set_rotation(std::size_t index, const glm::vec3& rotation_axis, float angular_speed)
+    {
+        rotation_axes[index] = rotation_axis;
+        angular_speeds[index] = angular_speed;
+    }
+    void set_scale(std::size_t index, const glm::vec3& scale) { scales[index] = scale; }
+
+    void update(double elapsed_seconds)
+    {
+        PAWN_CPU_SCOPE("transforms_update");
+        update(elapsed_seconds, 0, world.size());
+    }
+    /* Transforms [begin, end) only, disjoint ranges may be updated from different threads */
+    void update(double elapsed_seconds, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            /* Wrap in double before narrowing, so float precision does not degrade over long runs */
+            float angle = static_cast <float>(std::fmod(angular_speeds[i] * elapsed_seconds, 2.0 * PI));
+            glm::mat4 model = glm::translate(glm::mat4(1), positions[i]);
+            model = glm::rotate(model, angle, rotation_axes[i]);
+            world[i] = glm::scale(model, scales[i]);
+        }
+    }
+
+    /* Writes this frame's matrices into the next section of the ring, the storage is only re-created when transforms were added */
+    void upload()
+    {
+        if (world.empty()) { return; }
+        PAWN_CPU_SCOPE("transforms_upload");
+        PAWN_GL_SCOPE("transforms_upload");
+        if (ubo.get_size() != world.size() * sizeof(glm::mat4)) { ubo.resize(world.size() * sizeof(glm::mat4)); }
+        ubo.mark_dirty(0, world.size() * sizeof(glm::mat4));
+        ubo.update(world.data());
+    }
+
+    /* Makes the block containing index visible to the shader and returns its index inside that block */
+    unsigned int bind(std::size_t index) const
+    {
+        std::size_t block = index / BLOCK_CAPACITY;
+        GLState::bind_uniform_buffer_range(TRANSFORM_BLOCK_BINDING, ubo.get_id(), ubo.get_offset() + block * BLOCK_CAPACITY * sizeof(glm::mat4), 
+            BLOCK_CAPACITY * sizeof(glm::mat4));
+        return static_cast <unsigned int>(index % BLOCK_CAPACITY);
+    }
+};
+
+/* Planes of a view-projection matrix, normals pointing into the visible volume */
+class Frustum
+{
+private:
+    glm::vec4 planes[6];
+public:
+    enum Classification
+    {
+        OUTSIDE = -1, INTERSECTING = 0, INSIDE = 1
+    };
+
+    Frustum(const glm::mat4& view_projection)
+    {
+        /* Gribb-Hartmann: combinations of the matrix rows, glm stores columns */
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (auto& plane : planes)
+        {
+            plane = plane / glm::length(glm::vec3(plane));
+        }
+    }
+
+    Classification classify(const Bounds& box) const
+    {
+        Classification result = INSIDE;
+        for (const auto& plane : planes)
+        {
+            glm::vec3 normal(plane);
+            /* Box corners furthest along and against the plane normal */
+            glm::vec3 positive(normal.x >= 0 ? box.max.x : box.min.x, normal.y >= 0 ? box.max.y : box.min.y, normal.z >= 0 ? box.max.z : box.min.z);
+            glm::vec3 negative(normal.x >= 0 ? box.min.x : box.max.x, normal.y >= 0 ? box.min.y : box.max.y, normal.z >= 0 ? box.min.z : box.max.z);
+            if (glm::dot(normal, positive) + plane.w < 0.0f) { return OUTSIDE; }
+            if (glm::dot(normal, negative) + plane.w < 0.0f) { result = INTERSECTING; }
+        }
+        return result;
+    }
+};
+
+/* Binary tree of boxes over a set of items. Built once, then refitted bottom-up when items move */
+class BoundingVolumeHierarchy
+{
+private:
+    struct Node
+    {
+        Bounds box;
+        /* Children, -1 for leaves */
+        int left = -1, right = -1;
+        /* Range of items below this node in the items array */
+        unsigned int first = 0, count = 0;
+    };
+    static const unsigned int LEAF_SIZE = 4;
+
+    std::vector <Node> nodes;
+    std::vector <unsigned int> items;
+    std::vector <Bounds> item_bounds;
+    std::vector <unsigned int> stack;
+
+    /* Children are always stored after their parent, which refit relies on */
+    int build_node(const std::vector <Bounds>& bounds, unsigned int first, unsigned int count)
+    {
+        int index = static_cast <int>(nodes.size());
+        nodes.push_back(Node());
+        Bounds box, centers;
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            box.expand(bounds[items[i]]);
+            centers.expand(bounds[items[i]].get_center());
+        }
+        nodes[index].box = box;
+        nodes[index].first = first;
+        nodes[index].count = count;
+        if (count <= LEAF_SIZE) { return index; }
+
+        /* Median split along the axis where the item centers spread the most */
+        glm::vec3 spread = centers.max - centers.min;
+        int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+        unsigned int half = count / 2;
+        std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count, 
+            [&](unsigned int a, unsigned int b) { return bounds[a].get_center()[axis] < bounds[b].get_center()[axis]; });
+        int left = build_node(bounds, first, half);
+        int right = build_node(bounds, first + half, count - half);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+public:
+    void build(const std::vector <Bounds>& bounds)
+    {
+        item_bounds = bounds;
+        nodes.clear();
+        items.resize(bounds.size());
+        for (unsigned int i = 0; i < items.size(); ++i) { items[i] = i; }
+        if (!items.empty()) { build_node(bounds, 0, static_cast <unsigned int>(items.size())); }
+    }
+    /* Keeps the topology and only recomputes the boxes, children before parents */
+    void refit(const std::vector <Bounds>& bounds)
+    {
+        item_bounds = bounds;
+        for (std::size_t i = nodes.size(); i-- > 0;)
+        {
+            Node& node = nodes[i];
+            node.box = Bounds();
+            if (node.left < 0)
+            {
+                for (unsigned int j = node.first; j < node.first + node.count; ++j) { node.box.expand(bounds[items[j]]); }
+            }
+            else
+            {
+                node.box.expand(nodes[node.left].box);
+                node.box.expand(nodes[node.right].box);
+            }
+        }
+    }
+    std::size_t get_item_count() const { return items.size(); }
+
+    /* Appends the items whose boxes touch the frustum. Subtrees fully inside are accepted without further tests */
+    void cull(const Frustum& frustum, std::vector <unsigned int>& visible)
+    {
+        if (nodes.empty()) { return; }
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty())
+        {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            Frustum::Classification classification = frustum.classify(node.box);
+            if (classification == Frustum::OUTSIDE) { continue; }
+            if (classification == Frustum::INSIDE)
+            {
+                visible.insert(visible.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+                continue;
+            }
+            if (node.left < 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; ++i)
+                {
+                    if (frustum.classify(item_bounds[items[i]]) != Frustum::OUTSIDE) { visible.push_back(items[i]); }
+                }
+                continue;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+};
+
+/* Projected radius in pixels below which a figure drops to the next coarser level, one entry per level boundary */
+const float LOD_PIXEL_THRESHOLDS[LOD_LEVELS - 1] = { 64.0f, 16.0f };
+/* Fraction a threshold must be crossed by before the level changes, so figures near a boundary do not pop every frame */
+const float LOD_HYSTERESIS = 0.2f;
+
+/* Per detail level, what the last draw_composition drew and how many triangles it saved against level 0 */
+struct LodStats
+{
+    unsigned long long objects[LOD_LEVELS] = {};
+    unsigned long long triangles[LOD_LEVELS] = {};
+    unsigned long long triangles_saved[LOD_LEVELS] = {};
+};
+
+/* One vertex and element buffer holding copies of many meshes, each drawn through its element range and base vertex */
+class MergedGeometry
+{
+public:
+    struct Range
+    {
+        GLsizei count = 0;
+        /* Byte offset into the element buffer */
+        std::size_t first = 0;
+        GLint base_vertex = 0;
+    };
+private:
+    unsigned int vao = 0, vbo = 0, ibo = 0, cbo = 0;
+    std::size_t byte_size = 0;
+
+    void release()
+    {
+        if (vao == 0) { return; }
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        glDeleteBuffers(1, &cbo);
+        GLState::forget_vertex_array(vao);
+        glDeleteVertexArrays(1, &vao);
+        vao = vbo = ibo = cbo = 0;
+        byte_size = 0;
+    }
+public:
+    MergedGeometry() = default;
+    MergedGeometry(const MergedGeometry&) = delete;
+    MergedGeometry& operator =(const MergedGeometry&) = delete;
+
+    /* Copies the uploaded buffers of meshes on the GPU, so meshes whose CPU copy was released can be merged too.
+       Returns the range of meshes[i] */
+    std::vector <Range> build(const std::vector <const Mesh*>& meshes)
+    {
+        release();
+        std::vector <Range> ranges(meshes.size());
+        std::size_t vertices = 0, indices = 0, uncolored_vertices = 0;
+        bool colored = false;
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+        {
+            ranges[i].count = static_cast <GLsizei>(meshes[i]->get_index_count());
+            ranges[i].first = indices * sizeof(unsigned int);
+            ranges[i].base_vertex = static_cast <GLint>(vertices);
+            vertices += meshes[i]->get_vertex_count();
+            indices += meshes[i]->get_index_count();
+            if (meshes[i]->get_cbo() != 0) { colored = true; }
+            else { uncolored_vertices = std::max(uncolored_vertices, meshes[i]->get_vertex_count()); }
+        }
+        if (meshes.empty()) { return ranges; }
+
+        glGenVertexArrays(1, &vao);
+        GLState::bind_vertex_array(vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+        {
+            /* A dynamic mesh's ring sections may not all hold its latest edits yet, its CPU copy does */
+            if (meshes[i]->is_dynamic())
+            {
+                glBufferSubData(GL_ARRAY_BUFFER, ranges[i].base_vertex * sizeof(Vertex), meshes[i]->get_vertex_count() * sizeof(Vertex), 
+                    meshes[i]->get_vertices().data());
+            }
+            else
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, meshes[i]->get_vbo());
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, ranges[i].base_vertex * sizeof(Vertex), 
+                    meshes[i]->get_vertex_count() * sizeof(Vertex));
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, meshes[i]->get_ibo());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0, ranges[i].first, 
+                ranges[i].count * sizeof(unsigned int));
+        }
+        /* A color stream only when some mesh has one, meshes without get white */
+        if (colored)
+        {
+            const std::vector <glm::vec3> white(uncolored_vertices, glm::vec3(1.0f));
+            glGenBuffers(1, &cbo);
+            glBindBuffer(GL_ARRAY_BUFFER, cbo);
+            glBufferData(GL_ARRAY_BUFFER, vertices * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+            for (std::size_t i = 0; i < meshes.size(); ++i)
+            {
+                std::size_t offset = ranges[i].base_vertex * sizeof(glm::vec3), size = meshes[i]->get_vertex_count() * sizeof(glm::vec3);
+                if (meshes[i]->get_cbo() == 0) { glBufferSubData(GL_ARRAY_BUFFER, offset, size, white.data()); }
+                else
+                {
+                    glBindBuffer(GL_COPY_READ_BUFFER, meshes[i]->get_cbo());
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, offset, size);
+                }
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        ::record_vertex_layout(vbo, ibo, cbo);
+        GLState::bind_vertex_array(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        byte_size = vertices * sizeof(Vertex) + indices * sizeof(unsigned int) + (colored ? vertices * sizeof(glm::vec3) : 0);
+        return ranges;
+    }
+    bool is_built() const { return vao != 0; }
+    unsigned int get_vao() const { return vao; }
+    /* Points the currently bound VAO at the merged buffers */
+    void record_vertex_layout() const { ::record_vertex_layout(vbo, ibo, cbo); }
+    std::size_t get_byte_size() const { return byte_size; }
+
+    ~MergedGeometry() { release(); }
+};
+
+/* Runs batches of independent tasks on a fixed set of threads, the calling thread included. Every thread owns a
+   deque of tasks, takes from its front and, once it is empty, steals from the back of the others, so uneven
+   tasks still balance. Task functions get the index of the thread running them, for per-thread scratch data */
+class WorkStealingPool
+{
+private:
+    /* Tasks [begin, end), the owner takes from the front and thieves from the back, so no storage is needed */
+    struct Queue
+    {
+        std::mutex mutex;
+        std::size_t begin = 0, end = 0;
+    };
+    std::vector <std::thread> threads;
+    std::vector <std::unique_ptr <Queue>> queues;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function <void(std::size_t, unsigned int)>* job = nullptr;
+    unsigned long long generation = 0;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    bool take(unsigned int self, std::size_t& task)
+    {
+        for (std::size_t i = 0; i < queues.size(); ++i)
+        {
+            Queue& queue = *queues[(self + i) % queues.size()];
+            std::lock_guard <std::mutex> lock(queue.mutex);
+            if (queue.begin == queue.end) { continue; }
+            task = i == 0 ? queue.begin++ : --queue.end;
+            return true;
+        }
+        return false;
+    }
+    void work(unsigned int self)
+    {
+        std::size_t task;
+        while (take(self, task)) { (*job)(task, self); }
+    }
+    void worker(unsigned int self)
+    {
+        unsigned long long seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock <std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) { return; }
+                seen = generation;
+            }
+            work(self);
+            std::lock_guard <std::mutex> lock(mutex);
+            if (--running == 0) { finished.notify_one(); }
+        }
+    }
+public:
+    /* threads counts the calling thread, 0 uses every hardware thread */
+    explicit WorkStealingPool(unsigned int threads = 0)
+    {
+        if (threads == 0) { threads = std::max(std::thread::hardware_concurrency(), 1u); }
+        for (unsigned int i = 0; i < threads; ++i) { queues.push_back(std::make_unique <Queue>()); }
+        for (unsigned int i = 1; i < threads; ++i) { this->threads.emplace_back(&WorkStealingPool::worker, this, i); }
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator =(const WorkStealingPool&) = delete;
+
+    unsigned int get_thread_count() const { return static_cast <unsigned int>(queues.size()); }
+
+    /* Calls function(task, thread) for every task in [0, tasks) and returns once all of them are done */
+    void run(std::size_t tasks, const std::function <void(std::size_t, unsigned int)>& function)
+    {
+        if (tasks == 0) { return; }
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            job = &function;
+            /* Contiguous runs per thread, neighbouring tasks tend to touch neighbouring data */
+            for (std::size_t i = 0; i < queues.size(); ++i)
+            {
+                std::lock_guard <std::mutex> queue_lock(queues[i]->mutex);
+                queues[i]->begin = (i * tasks + queues.size() - 1) / queues.size();
+                queues[i]->end = ((i + 1) * tasks + queues.size() - 1) / queues.size();
+            }
+            running = static_cast <unsigned int>(threads.size());
+            ++generation;
+        }
+        wake.notify_all();
+        work(0);
+        std::unique_lock <std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return running == 0; });
+        job = nullptr;
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) { thread.join(); }
+    }
+};
+
+/* Per-instance data streamed next to a shared mesh, matching the instance attributes in pawn.shader */
+struct InstanceData
+{
+    glm::mat4 transform = glm::mat4(1);
+    glm::vec3 color = glm::vec3(1.0f);
+};
+
+/* Points the currently bound VAO's instance attributes at InstanceData records in buffer, starting at offset */
+void record_instance_layout(unsigned int buffer, std::size_t offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; ++column)
+    {
+        unsigned int location = INSTANCE_TRANSFORM_ATTRIBUTE + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), 
+            reinterpret_cast <void*>(offset + offsetof(InstanceData, transform) + column * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    glVertexAttribPointer(INSTANCE_COLOR_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), 
+        reinterpret_cast <void*>(offset + offsetof(InstanceData, color)));
+    glEnableVertexAttribArray(INSTANCE_COLOR_ATTRIBUTE);
+    glVertexAttribDivisor(INSTANCE_COLOR_ATTRIBUTE, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* Layout of one glMultiDrawElementsIndirect command */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+/* Bump allocator for scene objects. Objects are placed one after another in large blocks instead of being scattered
+   over the heap, and are destroyed together with the arena */
+class ObjectArena
+{
+private:
+    static const std::size_t BLOCK_SIZE = 64 * 1024;
+    std::vector <std::unique_ptr <unsigned char[]>> blocks;
+    std::size_t used = BLOCK_SIZE;
+    std::vector <Object3D*> objects;
+public:
+    ObjectArena() = default;
+    ObjectArena(const ObjectArena&) = delete;
+    ObjectArena& operator =(const ObjectArena&) = delete;
+
+    template <class T, class... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(sizeof(T) <= BLOCK_SIZE && alignof(T) <= alignof(std::max_align_t), "object does not fit an arena block");
+        std::size_t offset = (used + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (offset + sizeof(T) > BLOCK_SIZE)
+        {
+            blocks.emplace_back(new unsigned char[BLOCK_SIZE]);
+            offset = 0;
+        }
+        T* object = new (blocks.back().get() + offset) T(std::forward <Args>(args)...);
+        used = offset + sizeof(T);
+        objects.push_back(object);
+        return object;
+    }
+    std::size_t get_byte_size() const { return blocks.size() * BLOCK_SIZE; }
+
+    ~ObjectArena()
+    {
+        for (auto it = objects.rbegin(); it != objects.rend(); ++it) { (*it)->~Object3D(); }
+    }
+};
+
+/* Program, depth, VAO and transform from the most to the least significant, each at its full width: the queue
+   of a large scene holds well over 65536 transforms */
+struct DrawSortKey
+{
+    std::uint64_t high = 0;
+    std::uint64_t low = 0;
+
+    bool operator <(const DrawSortKey& other) const { return high != other.high ? high < other.high : low < other.low; }
+    bool operator ==(const DrawSortKey& other) const { return high == other.high && low == other.low; }
+};
+
+/* Everything needed to issue one draw, with no pointers back into the objects */
+struct DrawRecord
+{
+        DrawSortKey key;
+    unsigned int vao;
+    GLsizei count;
+    GLint base_vertex;
+    unsigned int transform;
+    Material material;
+};
+
+enum class DrawOrder
+{
+    /* Grouped by program and mesh, fewest state changes */
+    STATE,
+    /* Nearest first within each program, so the depth test rejects hidden fragments before they are shaded */
+    FRONT_TO_BACK
+};
+
+/* Closed shapes wind counter-clockwise seen from outside. Projections into GL's left-handed clip space, like
+   glm::perspective, keep that winding on screen; the identity of scenes placed directly in clip space mirrors it */
+inline GLenum front_face_winding(const glm::mat4& view_projection)
+{
+    return glm::determinant(glm::mat3(view_projection)) < 0.0f ? GL_CCW : GL_CW;
+}
+
+/* Orders by clip-space z, linear in view distance for perspective and orthographic projections alike.
+   The top 16 bits of the float made sortable as an unsigned integer, about 1% relative precision */
+inline std::uint16_t draw_sort_depth(const glm::mat4& view_projection, const glm::vec3& point)
+{
+    float z = (view_projection * glm::vec4(point, 1.0f)).z;
+    std::uint32_t bits;
+    std::memcpy(&bits, &z, sizeof(bits));
+    bits = bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+    return static_cast <std::uint16_t>(bits >> 16);
+}
+
+/* depth is 0 for DrawOrder::STATE. Transform ids fit 32 bits, DrawRecord keeps them as unsigned int too */
+inline DrawSortKey draw_sort_key(unsigned int program, std::uint16_t depth, unsigned int vao, std::size_t transform)
+{
+    DrawSortKey key;
+    key.high = (static_cast <std::uint64_t>(program) << 16) | depth;
+    key.low = (static_cast <std::uint64_t>(vao) << 32) | static_cast <std::uint32_t>(transform);
+    return key;
+}
+
+class Composition
+{
+private:
+    /* Objects built in place by emplace(), and those handed over through add() */
+    ObjectArena arena;
+    std::vector <std::unique_ptr <Object3D>> owned;
+    std::vector <Object3D*> figures;
+    /* Transform component of figures[i] */
+    std::vector <std::size_t> transform_ids;
+    TransformSystem transforms;
+    int transform_index_location = -1;
+    MaterialLocations material_locations;
+
+    /* World-space box of figures[i], refreshed after the transforms change */
+    std::vector <Bounds> world_bounds;
+    BoundingVolumeHierarchy bvh;
+    bool bvh_dirty = true, bounds_dirty = true;
+    std::vector <unsigned int> visible;
+    glm::mat4 view_projection = glm::mat4(1);
+    int view_projection_location = -1;
+    float viewport_height = 640.0f;
+    LodStats lod_stats;
+
+    /* Baked drawing: figures whose transforms and materials are identical never move relative to each other and
+       look the same, they share a group drawn with one multi-draw from the merged buffer */
+    struct BakedLevel
+    {
+        const Mesh* mesh = nullptr;
+        unsigned int version = 0;
+        MergedGeometry::Range range;
+    };
+    bool baked = false, bake_dirty = true;
+    MergedGeometry merged;
+    /* Levels of figures[i] start at baked_levels[baked_first[i]] */
+    std::vector <std::size_t> baked_first;
+    std::vector <BakedLevel> baked_levels;
+    std::vector <unsigned int> figure_groups;
+    /* Transform and material drawn for each group, those of its first figure */
+    std::vector <std::size_t> group_transforms;
+    std::vector <Material> group_materials;
+    /* Per-frame multi-draw arguments, kept to avoid reallocating */
+    std::vector <unsigned int> draw_order;
+    /* Sort depths of the visible figures and of their groups for DrawOrder::FRONT_TO_BACK */
+    std::vector <std::uint16_t> figure_depths;
+    std::vector <std::uint16_t> group_depths;
+    std::vector <GLsizei> draw_counts;
+    std::vector <const void*> draw_firsts;
+    std::vector <GLint> draw_base_vertices;
+
+    /* Render queue of the visible figures. The sorted order is reused while the keys stay the same as last frame */
+    std::vector <DrawRecord> queue;
+    std::vector <DrawSortKey> queue_keys;
+    std::vector <unsigned int> queue_order;
+    DrawOrder queue_sorting = DrawOrder::FRONT_TO_BACK;
+    /* Back faces are only culled while no figure is open, see set_face_culling() */
+    bool face_culling = true;
+    std::size_t open_figures = 0;
+    /* Depth-only program of the pre-pass, see set_depth_prepass() */
+    std::shared_ptr <ShaderProgram> depth_program;
+    int depth_transform_index_location = -1, depth_view_projection_location = -1;
+    /* The skip on the baked and recorded paths is reported once */
+    bool depth_prepass_skip_reported = false;
+
+    /* Recorded drawing, see set_recording_pool(): each pool thread writes the draw commands and instance packets of
+       the figures it processed into its own arena, the render thread merges them into one multi-draw indirect */
+    static constexpr std::size_t RECORDING_CHUNK = 1024;
+    struct RecordingArena
+    {
+        std::vector <DrawElementsIndirectCommand> commands;
+        std::vector <InstanceData> instances;
+        std::vector <float> gradients;
+        LodStats lods;
+        /* A figure's mesh changed since the last bake */
+        bool stale = false;
+    };
+    WorkStealingPool* recording_pool = nullptr;
+    std::vector <RecordingArena> recording_arenas;
+    /* Bound once, it only captures this so std::function keeps it in its small buffer. The frame's frustum and
+       focal length are members for the same reason */
+    std::function <void(std::size_t, unsigned int)> record_task = [this](std::size_t task, unsigned int thread)
+    {
+        record(task * RECORDING_CHUNK, std::min(figures.size(), (task + 1) * RECORDING_CHUNK), thread, recording_frustum, recording_focal);
+    };
+    Frustum recording_frustum{ glm::mat4(1) };
+    float recording_focal = 0.0f;
+    double recording_elapsed = 0.0;
+    std::size_t recorded_count = 0;
+    /* Merged output, commands grouped by material gradient. Sized to the buffer capacity */
+    std::vector <DrawElementsIndirectCommand> recorded_commands;
+    std::vector <InstanceData> recorded_instances;
+    std::vector <float> recorded_gradients;
+    std::vector <std::size_t> recorded_group_ends;
+    /* Scatter cursors of merge_recordings(), only ever grown */
+    std::vector <std::size_t> recorded_group_next;
+    std::size_t recording_capacity = 0;
+    DynamicBuffer command_buffer{ GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) };
+    DynamicBuffer packet_buffer{ GL_ARRAY_BUFFER, sizeof(InstanceData) };
+    /* Merged geometry plus the instance packets as instance attributes */
+    unsigned int recording_vao = 0;
+    bool recording_layout_dirty = true;
+    /* Uniform block of identity matrices, recorded draws carry their world matrix in the instance transform */
+    unsigned int identity_block = 0;
+
+    /* Detects edits made since the last bake: a re-uploaded or replaced mesh at any level */
+    bool is_bake_current() const
+    {
+        if (bake_dirty || baked_first.size() != figures.size()) { return false; }
+        for (std::size_t i = 0; i < figures.size(); ++i)
+        {
+            std::size_t levels = figures[i]->get_lod_count();
+            std::size_t end = i + 1 < figures.size() ? baked_first[i + 1] : baked_levels.size();
+            if (end - baked_first[i] != levels) { return false; }
+            for (std::size_t level = 0; level < levels; ++level)
+            {
+                const Mesh* mesh = figures[i]->get_lod_mesh(static_cast <unsigned int>(level)).get();
+                const BakedLevel& baked_level = baked_levels[baked_first[i] + level];
+                if (baked_level.mesh != mesh || baked_level.version != mesh->get_version()) { return false; }
+            }
+        }
+        return true;
+    }
+
+    void rebake()
+    {
+        /* Shared meshes are copied once */
+        std::vector <const Mesh*> unique_meshes;
+        std::map <const Mesh*, std::size_t> mesh_slots;
+        baked_first.clear();
+        baked_levels.clear();
+        for (Object3D* figure : figures)
+        {
+            baked_first.push_back(baked_levels.size());
+            for (unsigned int level = 0; level < figure->get_lod_count(); ++level)
+            {
+                const Mesh* mesh = figure->get_lod_mesh(level).get();
+                if (mesh_slots.insert({ mesh, unique_meshes.size() }).second) { unique_meshes.push_back(mesh); }
+                baked_levels.push_back({ mesh, mesh->get_version(), {} });
+            }
+        }
+        std::vector <MergedGeometry::Range> ranges = merged.build(unique_meshes);
+        for (BakedLevel& level : baked_levels) { level.range = ranges[mesh_slots[level.mesh]]; }
+
+        std::map <std::vector <float>, unsigned int> groups;
+        figure_groups.clear();
+        group_transforms.clear();
+        group_materials.clear();
+        for (std::size_t i = 0; i < figures.size(); ++i)
+        {
+            std::size_t id = transform_ids[i];
+            const glm::vec3& p = transforms.get_position(id), & a = transforms.get_rotation_axis(id), & s = transforms.get_scale(id);
+            const Material& material = figures[i]->get_material();
+            std::vector <float> key = { p.x, p.y, p.z, a.x, a.y, a.z, transforms.get_angular_speed(id), s.x, s.y, s.z, 
+                material.color.x, material.color.y, material.color.z, material.gradient };
+            auto group = groups.insert({ key, static_cast <unsigned int>(group_transforms.size()) });
+            if (group.second)
+            {
+                group_transforms.push_back(id);
+                group_materials.push_back(material);
+            }
+            figure_groups.push_back(group.first->second);
+        }
+        bake_dirty = false;
+        recording_layout_dirty = true;
+    }
+
+    void draw_baked()
+    {
+        if (!is_bake_current()) { rebake(); }
+        if (visible.empty()) { return; }
+        draw_order.assign(visible.begin(), visible.end());
+        /* Ties broken by index instead of std::stable_sort, which allocates a buffer every call */
+        if (queue_sorting == DrawOrder::FRONT_TO_BACK)
+        {
+            /* A group is drawn as a whole, ranked by its nearest figure */
+            figure_depths.resize(figures.size());
+            group_depths.assign(group_transforms.size(), 0xFFFF);
+            for (unsigned int figure : draw_order)
+            {
+                figure_depths[figure] = draw_sort_depth(view_projection, world_bounds[figure].get_center());
+                std::uint16_t& depth = group_depths[figure_groups[figure]];
+                depth = std::min(depth, figure_depths[figure]);
+            }
+            std::sort(draw_order.begin(), draw_order.end(), [this](unsigned int a, unsigned int b)
+            {
+                unsigned int group_a = figure_groups[a], group_b = figure_groups[b];
+                if (group_a != group_b) { return group_depths[group_a] != group_depths[group_b] ? group_depths[group_a] < group_depths[group_b] : group_a < group_b; }
+                return figure_depths[a] != figure_depths[b] ? figure_depths[a] < figure_depths[b] : a < b;
+            });
+        }
+        else
+        {
+            std::sort(draw_order.begin(), draw_order.end(), [this](unsigned int a, unsigned int b)
+            {
+                return figure_groups[a] != figure_groups[b] ? figure_groups[a] < figure_groups[b] : a < b;
+            });
+        }
+        draw_counts.resize(draw_order.size());
+        draw_firsts.resize(draw_order.size());
+        draw_base_vertices.resize(draw_order.size());
+        for (std::size_t i = 0; i < draw_order.size(); ++i)
+        {
+            unsigned int figure = draw_order[i];
+            const MergedGeometry::Range& range = baked_levels[baked_first[figure] + figures[figure]->get_lod()].range;
+            draw_counts[i] = range.count;
+            draw_firsts[i] = reinterpret_cast <const void*>(range.first);
+            draw_base_vertices[i] = range.base_vertex;
+        }
+
+        GLState::bind_vertex_array(merged.get_vao());
+        for (std::size_t begin = 0, end = 0; begin < draw_order.size(); begin = end)
+        {
+            unsigned int group = figure_groups[draw_order[begin]];
+            PAWN_CPU_SCOPE("draw_baked");
+            PAWN_GL_SCOPE("draw_baked");
+            unsigned long long triangles = 0;
+            for (end = begin; end < draw_order.size() && figure_groups[draw_order[end]] == group; ++end) { triangles += draw_counts[end] / 3; }
+            GL_COUNTED(glUniform1i(transform_index_location, transforms.bind(group_transforms[group])));
+            if (begin == 0 || group_materials[group] != group_materials[figure_groups[draw_order[begin - 1]]]) { material_locations.apply(group_materials[group]); }
+            GL_COUNTED(glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw_counts.data() + begin, GL_UNSIGNED_INT, draw_firsts.data() + begin, 
+                static_cast <GLsizei>(end - begin), draw_base_vertices.data() + begin));
+            GLState::count_draw(triangles);
+        }
+    }
+
+    /* Pixels per world unit at unit clip w, the larger of the x and y scales of the projection */
+    float get_focal() const
+    {
+        const glm::mat4& m = view_projection;
+        return std::max(glm::length(glm::vec3(m[0][0], m[1][0], m[2][0])), glm::length(glm::vec3(m[0][1], m[1][1], m[2][1])));
+    }
+    /* Sets the detail level of figure from the projected radius of its world box, adds it to stats and returns it */
+    unsigned int select_lod(Object3D& figure, const Bounds& world, float focal, LodStats& stats) const
+    {
+        glm::vec4 clip = view_projection * glm::vec4(world.get_center(), 1.0f);
+        float pixels = world.get_radius() * focal / std::max(clip.w, 1e-4f) * viewport_height * 0.5f;
+
+        unsigned int current = figure.get_lod(), level = 0;
+        while (level + 1 < figure.get_lod_count() && level < LOD_LEVELS - 1)
+        {
+            /* Leaving the current level needs a margin in either direction */
+            float threshold = LOD_PIXEL_THRESHOLDS[level];
+            if (level < current) { threshold *= 1.0f + LOD_HYSTERESIS; }
+            else { threshold *= 1.0f - LOD_HYSTERESIS; }
+            if (pixels >= threshold) { break; }
+            ++level;
+        }
+        figure.set_lod(level);
+
+        unsigned long long triangles = figure.get_index_count() / 3;
+        stats.objects[level] += 1;
+        stats.triangles[level] += triangles;
+        stats.triangles_saved[level] += figure.get_lod_mesh(0)->get_index_count() / 3 - triangles;
+        return level;
+    }
+    /* Picks the detail level of every visible figure from the projected radius of its world bounds */
+    void select_lods()
+    {
+        PAWN_CPU_SCOPE("select_lods");
+        lod_stats = LodStats();
+        float focal = get_focal();
+        for (unsigned int i : visible) { select_lod(*figures[i], world_bounds[i], focal, lod_stats); }
+    }
+
+    bool is_recording() const { return recording_pool != nullptr && GLEW_ARB_base_instance; }
+
+    /* Recording phase of figures [first, last) on pool thread `thread`: transform, visibility, detail level and
+       the draw packet, touching nothing shared but the figures themselves */
+    void record(std::size_t first, std::size_t last, unsigned int thread, const Frustum& frustum, float focal)
+    {
+        RecordingArena& arena = recording_arenas[thread];
+        for (std::size_t i = first; i < last; ++i)
+        {
+            std::size_t id = transform_ids[i];
+            transforms.update(recording_elapsed, id, id + 1);
+            const glm::mat4& world = transforms.get_world(id);
+            Object3D& figure = *figures[i];
+            Bounds box = figure.get_bounds().transformed(world);
+            if (frustum.classify(box) == Frustum::OUTSIDE) { continue; }
+            unsigned int level = select_lod(figure, box, focal, arena.lods);
+
+            std::size_t end = i + 1 < figures.size() ? baked_first[i + 1] : baked_levels.size();
+            const BakedLevel* baked_level = baked_first[i] + level < end ? &baked_levels[baked_first[i] + level] : nullptr;
+            if (!baked_level || baked_level->mesh != figure.get_mesh().get() || baked_level->version != baked_level->mesh->get_version())
+            {
+                arena.stale = true;
+                continue;
+            }
+            const MergedGeometry::Range& range = baked_level->range;
+            arena.commands.push_back({ static_cast <GLuint>(range.count), 1, static_cast <GLuint>(range.first / sizeof(unsigned int)), 
+                range.base_vertex, static_cast <GLuint>(arena.instances.size()) });
+            arena.instances.push_back({ world, figure.get_material().color });
+            arena.gradients.push_back(figure.get_material().gradient);
+        }
+    }
+    void record_figures()
+    {
+        PAWN_CPU_SCOPE("record");
+        recording_frustum = Frustum(view_projection);
+        recording_focal = get_focal();
+        for (RecordingArena& arena : recording_arenas)
+        {
+            arena.commands.clear();
+            arena.instances.clear();
+            arena.gradients.clear();
+            arena.lods = LodStats();
+            arena.stale = false;
+        }
+        recording_pool->run((figures.size() + RECORDING_CHUNK - 1) / RECORDING_CHUNK, record_task);
+    }
+    /* Concatenates the arenas, grouped by gradient since that is the one material value set per multi-draw */
+    void merge_recordings()
+    {
+        PAWN_CPU_SCOPE("merge");
+        lod_stats = LodStats();
+        recorded_gradients.clear();
+        std::vector <std::size_t>& ends = recorded_group_ends;
+        ends.clear();
+        std::size_t total = 0;
+        for (const RecordingArena& arena : recording_arenas)
+        {
+            total += arena.commands.size();
+            for (unsigned int level = 0; level < LOD_LEVELS; ++level)
+            {
+                lod_stats.objects[level] += arena.lods.objects[level];
+                lod_stats.triangles[level] += arena.lods.triangles[level];
+                lod_stats.triangles_saved[level] += arena.lods.triangles_saved[level];
+            }
+            std::size_t group = 0;
+            for (float gradient : arena.gradients)
+            {
+                /* Few distinct gradients, mostly in runs */
+                if (group >= recorded_gradients.size() || recorded_gradients[group] != gradient)
+                {
+                    group = std::find(recorded_gradients.begin(), recorded_gradients.end(), gradient) - recorded_gradients.begin();
+                    if (group == recorded_gradients.size())
+                    {
+                        recorded_gradients.push_back(gradient);
+                        ends.push_back(0);
+                    }
+                }
+                ++ends[group];
+            }
+        }
+        recorded_count = total;
+        if (total > recording_capacity)
+        {
+            recording_capacity = std::max <std::size_t>(total + total / 2, RECORDING_CHUNK);
+            recorded_commands.resize(recording_capacity);
+            recorded_instances.resize(recording_capacity);
+            command_buffer.resize(recording_capacity * sizeof(DrawElementsIndirectCommand));
+            packet_buffer.resize(recording_capacity * sizeof(InstanceData));
+            recording_layout_dirty = true;
+        }
+        /* Counts to group offsets, then scatter */
+        std::vector <std::size_t>& next = recorded_group_next;
+        if (next.size() < ends.size()) { next.resize(ends.size()); }
+        for (std::size_t group = 0, offset = 0; group < ends.size(); ++group)
+        {
+            next[group] = offset;
+            offset += ends[group];
+            ends[group] = offset;
+        }
+        for (const RecordingArena& arena : recording_arenas)
+        {
+            std::size_t group = 0;
+            for (std::size_t i = 0; i < arena.commands.size(); ++i)
+            {
+                if (recorded_gradients[group] != arena.gradients[i])
+                {
+                    group = std::find(recorded_gradients.begin(), recorded_gradients.end(), arena.gradients[i]) - recorded_gradients.begin();
+                }
+                std::size_t slot = next[group]++;
+                recorded_commands[slot] = arena.commands[i];
+                recorded_commands[slot].base_instance = static_cast <GLuint>(slot);
+                recorded_instances[slot] = arena.instances[i];
+            }
+        }
+    }
+    void draw_recorded()
+    {
+        if (bake_dirty || baked_first.size() != figures.size()) { rebake(); }
+        record_figures();
+        if (std::any_of(recording_arenas.begin(), recording_arenas.end(), [](const RecordingArena& arena) { return arena.stale; }))
+        {
+            rebake();
+            record_figures();
+        }
+        merge_recordings();
+        /* Transforms were updated in place, culling and baking must not trust their cached boxes */
+        bounds_dirty = true;
+        if (recorded_count == 0) { return; }
+
+        packet_buffer.mark_dirty(0, recorded_count * sizeof(InstanceData));
+        packet_buffer.update(recorded_instances.data());
+        /* Packets were numbered from 0, move them into this frame's section */
+        GLuint base = static_cast <GLuint>(packet_buffer.get_offset() / sizeof(InstanceData));
+        for (std::size_t i = 0; i < recorded_count; ++i) { recorded_commands[i].base_instance += base; }
+        command_buffer.mark_dirty(0, recorded_count * sizeof(DrawElementsIndirectCommand));
+        command_buffer.update(recorded_commands.data());
+
+        if (recording_vao == 0) { glGenVertexArrays(1, &recording_vao); }
+        if (identity_block == 0)
+        {
+            std::vector <glm::mat4> identities(TransformSystem::BLOCK_CAPACITY, glm::mat4(1));
+            glGenBuffers(1, &identity_block);
+            glBindBuffer(GL_UNIFORM_BUFFER, identity_block);
+            glBufferData(GL_UNIFORM_BUFFER, identities.size() * sizeof(glm::mat4), identities.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        GLState::bind_vertex_array(recording_vao);
+        if (recording_layout_dirty)
+        {
+            merged.record_vertex_layout();
+            record_instance_layout(packet_buffer.get_id(), 0);
+            recording_layout_dirty = false;
+        }
+        GLState::bind_uniform_buffer_range(TRANSFORM_BLOCK_BINDING, identity_block, 0, TransformSystem::BLOCK_CAPACITY * sizeof(glm::mat4));
+        GL_COUNTED(glUniform1i(transform_index_location, 0));
+        GL_COUNTED(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer.get_id()));
+        for (std::size_t group = 0, begin = 0; group < recorded_group_ends.size(); begin = recorded_group_ends[group++])
+        {
+            PAWN_CPU_SCOPE("draw_recorded");
+            PAWN_GL_SCOPE("draw_recorded");
+            std::size_t end = recorded_group_ends[group];
+            /* The color comes with each packet */
+            material_locations.apply({ glm::vec3(1.0f), recorded_gradients[group] });
+            unsigned long long triangles = 0;
+            for (std::size_t i = begin; i < end; ++i) { triangles += recorded_commands[i].count / 3; }
+            if (GLEW_ARB_multi_draw_indirect)
+            {
+                GL_COUNTED(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 
+                    reinterpret_cast <const void*>(command_buffer.get_offset() + begin * sizeof(DrawElementsIndirectCommand)), 
+                    static_cast <GLsizei>(end - begin), 0));
+                GLState::count_draw(triangles);
+                continue;
+            }
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const DrawElementsIndirectCommand& command = recorded_commands[i];
+                GL_COUNTED(glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, 
+                    reinterpret_cast <const void*>(static_cast <std::size_t>(command.first_index) * sizeof(unsigned int)), 1, command.base_vertex, 
+                    command.base_instance));
+                GLState::count_draw(command.count / 3);
+            }
+        }
+        GL_COUNTED(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    }
+
+    void build_queue(unsigned int program)
+    {
+        PAWN_CPU_SCOPE("build_queue");
+        queue.resize(visible.size());
+        bool same_keys = queue_keys.size() == visible.size();
+        queue_keys.resize(visible.size());
+        for (std::size_t i = 0; i < visible.size(); ++i)
+        {
+            Mesh& mesh = *figures[visible[i]]->get_mesh();
+            mesh.stream();
+            std::size_t transform = transform_ids[visible[i]];
+            DrawRecord& record = queue[i];
+            std::uint16_t depth = queue_sorting == DrawOrder::FRONT_TO_BACK ? draw_sort_depth(view_projection, world_bounds[visible[i]].get_center()) : 0;
+            record.key = draw_sort_key(program, depth, mesh.get_vao(), transform);
+            record.vao = mesh.get_vao();
+            record.count = static_cast <GLsizei>(mesh.get_index_count());
+            record.base_vertex = mesh.is_dynamic() ? mesh.get_base_vertex() : 0;
+            record.transform = static_cast <unsigned int>(transform);
+            record.material = figures[visible[i]]->get_material();
+            same_keys = same_keys && queue_keys[i] == record.key;
+            queue_keys[i] = record.key;
+        }
+        if (same_keys && queue_order.size() == queue.size()) { return; }
+        queue_order.resize(queue.size());
+        for (std::size_t i = 0; i < queue_order.size(); ++i) { queue_order[i] = static_cast <unsigned int>(i); }
+        std::sort(queue_order.begin(), queue_order.end(), [this](unsigned int a, unsigned int b) { return queue_keys[a] < queue_keys[b]; });
+    }
+
+    /* Lays down the depth of the queue with color and stencil writes off, so the shaded pass only runs the fragment
+       shader for the nearest surface of each pixel */
+    void draw_depth_prepass()
+    {
+        PAWN_CPU_SCOPE("depth_prepass");
+        PAWN_GL_SCOPE("depth_prepass");
+        depth_program->use();
+        GL_COUNTED(glUniformMatrix4fv(depth_view_projection_location, 1, GL_FALSE, glm::value_ptr<float>(view_projection)));
+        GL_COUNTED(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+        GL_COUNTED(glStencilMask(0));
+        unsigned int vao = 0;
+        for (unsigned int index : queue_order)
+        {
+            const DrawRecord& record = queue[index];
+            if (record.vao != vao)
+            {
+                vao = record.vao;
+                GLState::bind_vertex_array(vao);
+            }
+            GL_COUNTED(glUniform1i(depth_transform_index_location, transforms.bind(record.transform)));
+            if (record.base_vertex != 0)
+            {
+                GL_COUNTED(glDrawElementsBaseVertex(GL_TRIANGLES, record.count, GL_UNSIGNED_INT, 0, record.base_vertex));
+            }
+            else { GL_COUNTED(glDrawElements(GL_TRIANGLES, record.count, GL_UNSIGNED_INT, 0)); }
+            GLState::count_draw(record.count / 3);
+        }
+        GL_COUNTED(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+        GL_COUNTED(glStencilMask(0xFF));
+    }
+
+    void draw_queue()
+    {
+        unsigned int vao = 0;
+        const Material* material = nullptr;
+        for (unsigned int index : queue_order)
+        {
+            const DrawRecord& record = queue[index];
+            PAWN_CPU_SCOPE("draw");
+            PAWN_GL_SCOPE("draw");
+            if (record.vao != vao)
+            {
+                vao = record.vao;
+                GLState::bind_vertex_array(vao);
+            }
+            if (!material || record.material != *material)
+            {
+                material = &record.material;
+                material_locations.apply(*material);
+            }
+            GL_COUNTED(glUniform1i(transform_index_location, transforms.bind(record.transform)));
+            if (record.base_vertex != 0)
+            {
+                GL_COUNTED(glDrawElementsBaseVertex(GL_TRIANGLES, record.count, GL_UNSIGNED_INT, 0, record.base_vertex));
+            }
+            else { GL_COUNTED(glDrawElements(GL_TRIANGLES, record.count, GL_UNSIGNED_INT, 0)); }
+            GLState::count_draw(record.count / 3);
+        }
+    }
+
+    void add_figure(Object3D* obj, const Rotatable* r)
+    {
+        figures.push_back(obj);
+        if (!obj->is_closed()) { ++open_figures; }
+        bvh_dirty = bounds_dirty = bake_dirty = true;
+        /* Objects that are not Rotatable get a static transform */
+        transform_ids.push_back(r ? transforms.add(r->get_pivot(), r->get_angular_speed()) : transforms.add(glm::vec3(0.0f, 1.0f, 0.0f), 0.0f));
+    }
+
+    void update_visibility()
+    {
+        PAWN_CPU_SCOPE("cull");
+        if (bounds_dirty)
+        {
+            world_bounds.resize(figures.size());
+            for (std::size_t i = 0; i < figures.size(); ++i)
+            {
+                world_bounds[i] = figures[i]->get_bounds().transformed(transforms.get_world(transform_ids[i]));
+            }
+            if (bvh_dirty) { bvh.build(world_bounds); }
+            else { bvh.refit(world_bounds); }
+            bvh_dirty = bounds_dirty = false;
+        }
+        visible.clear();
+        bvh.cull(Frustum(view_projection), visible);
+        /* Keep insertion order among the visible figures */
+        std::sort(visible.begin(), visible.end());
+    }
+public:
+    Composition() = default;
+    Composition(const Composition&) = delete;
+    Composition& operator =(const Composition&) = delete;
+
+    /* Takes ownership of a heap-allocated object */
+    void add(Object3D* obj)
+    {
+        owned.emplace_back(obj);
+        add_figure(obj, dynamic_cast <Rotatable*>(obj));
+    }
+    /* Builds the object in the composition's arena */
+    template <class T, class... Args>
+    T& emplace(Args&&... args)
+    {
+        T* obj = arena.create <T>(std::forward <Args>(args)...);
+        if constexpr (std::is_base_of <Rotatable, T>::value) { add_figure(obj, obj); }
+        else { add_figure(obj, nullptr); }
+        return *obj;
+    }
+    std::size_t get_figure_count() const { return figures.size(); }
+    const Object3D& get_figure(std::size_t index) const { return *figures[index]; }
+    /* Material edits show from the next draw, before bake() only for baked compositions */
+    Object3D& get_figure(std::size_t index) { return *figures[index]; }
+    /* Index of the figure's matrix in get_transforms() */
+    std::size_t get_transform_id(std::size_t index) const { return transform_ids[index]; }
+
+    /* Order of the render queue and of baked drawing. Baked figures stay grouped by transform and material, so
+       FRONT_TO_BACK draws the groups by their nearest figure and the figures of each group nearest first.
+       Recorded drawing keeps the order the pool threads recorded in */
+    void set_draw_order(DrawOrder draw_order) { queue_sorting = draw_order; }
+    DrawOrder get_draw_order() const { return queue_sorting; }
+    /* Culls back faces while every figure is closed (see Object3D::is_closed()), false draws them regardless */
+    void set_face_culling(bool enabled) { face_culling = enabled; }
+    /* Draws the render queue twice: depth only with program, which must share the vertex stage of the shaded program
+       (see depth_only()), then shaded with the depth test at GL_LEQUAL and depth writes off. Pays off for fragment-heavy
+       shaders on scenes with overdraw. Baked and recorded drawing skip it. nullptr turns it off */
+    void set_depth_prepass(std::shared_ptr <ShaderProgram> program)
+    {
+        depth_program = std::move(program);
+        if (!depth_program) { return; }
+        depth_transform_index_location = depth_program->uniform("transformIndex");
+        depth_view_projection_location = depth_program->uniform("viewProjection");
+        depth_program->bind_uniform_block("Transforms", TRANSFORM_BLOCK_BINDING);
+    }
+
+    /* Splits each frame in two: the pool's threads update transforms, cull, pick detail levels and record draw
+       packets for disjoint chunks of figures, then the render thread submits them all with multi-draw indirect from
+       the merged buffer. Needs GL_ARB_base_instance, without it drawing stays on the render thread. nullptr turns it off */
+    void set_recording_pool(WorkStealingPool* pool)
+    {
+        recording_pool = pool;
+        recording_arenas.clear();
+        if (pool) { recording_arenas.resize(pool->get_thread_count()); }
+        bounds_dirty = true;
+    }
+    /* For scenes whose meshes never change after upload */
+    void release_cpu_copies()
+    {
+        for (const auto& i : figures)
+        {
+            i->release_cpu_copy();
+        }
+    }
+    /* Callers that edit transforms directly must call mark_transforms_changed() */
+    TransformSystem& get_transforms() { return transforms; }
+    void mark_transforms_changed() { bounds_dirty = bake_dirty = true; }
+
+    /* Switches drawing to the merged buffer. Figures stay editable: re-uploading one of their meshes,
+       adding figures or changing transforms re-bakes before the next draw */
+    void bake()
+    {
+        baked = true;
+        rebake();
+    }
+    bool is_baked() const { return baked; }
+    std::size_t get_baked_byte_size() const { return merged.get_byte_size(); }
+
+    void set_view_projection(const glm::mat4& view_projection) { this->view_projection = view_projection; }
+    const glm::mat4& get_view_projection() const { return view_projection; }
+    /* Figures that passed culling in the last draw_composition */
+    std::size_t get_visible_count() const { return is_recording() ? recorded_count : visible.size(); }
+    /* Height of the render target in pixels, used to turn projected sizes into screen sizes */
+    void set_viewport_height(float viewport_height) { this->viewport_height = viewport_height; }
+    const LodStats& get_lod_stats() const { return lod_stats; }
+    /* Runs the frustum test alone, without drawing */
+    const std::vector <unsigned int>& cull()
+    {
+        update_visibility();
+        return visible;
+    }
+
+    void init_rotation(const ShaderProgram& shader)
+    {
+        transform_index_location = shader.uniform("transformIndex");
+        view_projection_location = shader.uniform("viewProjection");
+        material_locations.init(shader);
+        shader.bind_uniform_block("Transforms", TRANSFORM_BLOCK_BINDING);
+    }
+
+    /* Bytes every distinct mesh at every detail level saves by drawing without a per-vertex color stream */
+    std::size_t get_color_bytes_saved() const
+    {
+        std::vector <const Mesh*> meshes;
+        for (const Object3D* figure : figures)
+        {
+            for (unsigned int level = 0; level < figure->get_lod_count(); ++level) { meshes.push_back(figure->get_lod_mesh(level).get()); }
+        }
+        std::sort(meshes.begin(), meshes.end());
+        meshes.erase(std::unique(meshes.begin(), meshes.end()), meshes.end());
+        std::size_t saved = 0;
+        for (const Mesh* mesh : meshes) { saved += mesh->get_color_bytes_saved(); }
+        return saved;
+    }
+
+    void apply_rotation(double elapsed_seconds)
+    {
+        /* Recording threads update the transforms of the figures they process */
+        if (is_recording())
+        {
+            recording_elapsed = elapsed_seconds;
+            return;
+        }
+        transforms.update(elapsed_seconds);
+        transforms.upload();
+        bounds_dirty = true;
+    }
+
+    /* Draws only the figures whose world boxes intersect the view frustum, each at the detail level its screen size calls for.
+       Unbaked figures go through a render queue sorted by program, VAO and transform */
+    void draw_composition(const ShaderProgram& shader)
+    {
+        GLState::set_face_culling(face_culling && open_figures == 0, front_face_winding(view_projection));
+        if (depth_program && (baked || is_recording()) && !depth_prepass_skip_reported)
+        {
+            std::cout << "[Composition]: Depth pre-pass skipped, it only runs on the render queue, not on " 
+                << (is_recording() ? "recorded" : "baked") << " drawing" << std::endl;
+            depth_prepass_skip_reported = true;
+        }
+        if (is_recording())
+        {
+            shader.use();
+            GL_COUNTED(glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, glm::value_ptr<float>(view_projection)));
+            draw_recorded();
+            return;
+        }
+        update_visibility();
+        select_lods();
+        shader.use();
+        GL_COUNTED(glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, glm::value_ptr<float>(view_projection)));
+        if (baked)
+        {
+            draw_baked();
+            return;
+        }
+        build_queue(shader.get_id());
+        if (!depth_program)
+        {
+            draw_queue();
+            return;
+        }
+        draw_depth_prepass();
+        shader.use();
+        GLenum depth_func = GLState::get_depth_func();
+        GLState::set_depth_func(GL_LEQUAL);
+        GL_COUNTED(glDepthMask(GL_FALSE));
+        draw_queue();
+        GL_COUNTED(glDepthMask(GL_TRUE));
+        GLState::set_depth_func(depth_func);
+    }
+
+    ~Composition()
+    {
+        if (recording_vao != 0)
+        {
+            GLState::forget_vertex_array(recording_vao);
+            glDeleteVertexArrays(1, &recording_vao);
+        }
+        if (identity_block != 0)
+        {
+            GLState::forget_uniform_buffer(identity_block);
+            glDeleteBuffers(1, &identity_block);
+        }
+    }
+};
+
+/* Draws N copies of each added mesh with one instanced draw call per mesh, regardless of N */
+class InstancedComposition : public Rotatable
+{
+private:
+    struct Batch
+    {
+        Object3D* mesh = nullptr;
+        unsigned int vao = 0;
+    };
+    std::vector <Batch> batches;
+    /* CPU mirror of the instance ring, edits only copy the changed instances into each section */
+    std::vector <InstanceData> instances;
+    DynamicBuffer instance_buffer{ GL_ARRAY_BUFFER, sizeof(InstanceData) };
+    /* Buffer and offset the batch VAOs' instance attributes were last pointed at */
+    unsigned int layout_buffer = 0;
+    std::size_t layout_offset = 0;
+    /* Holds the single transform of the whole board */
+    TransformSystem transforms;
+    std::size_t transform_id = 0;
+    int transform_index_location = -1;
+    glm::mat4 view_projection = glm::mat4(1);
+    int view_projection_location = -1;
+    MaterialLocations material_locations;
+    bool face_culling = true;
+
+public:
+    InstancedComposition() : Rotatable()
+    {
+        transform_id = transforms.add(this->get_pivot(), this->get_angular_speed());
+    }
+    InstancedComposition(const InstancedComposition&) = delete;
+    InstancedComposition& operator =(const InstancedComposition&) = delete;
+
+    /* Takes ownership of the mesh, its buffers are shared by every instance */
+    void add(Object3D* obj)
+    {
+        Batch batch;
+        batch.mesh = obj;
+        glGenVertexArrays(1, &batch.vao);
+        GLState::bind_vertex_array(batch.vao);
+        obj->record_vertex_layout();
+        GLState::bind_vertex_array(0);
+        batches.push_back(batch);
+        /* The new VAO has no instance attributes yet */
+        layout_buffer = 0;
+    }
+    template <class T, class... Args>
+    T& emplace(Args&&... args)
+    {
+        T* obj = new T(std::forward <Args>(args)...);
+        add(obj);
+        return *obj;
+    }
+
+    std::size_t add_instance(const glm::mat4& transform, const glm::vec3& color)
+    {
+        instances.push_back({ transform, color });
+        return instances.size() - 1;
+    }
+    void set_instance(std::size_t index, const glm::mat4& transform, const glm::vec3& color)
+    {
+        instances[index] = { transform, color };
+        instance_buffer.mark_dirty(index * sizeof(InstanceData), sizeof(InstanceData));
+    }
+    const InstanceData& get_instance(std::size_t index) const { return instances[index]; }
+    std::size_t get_mesh_count() const { return batches.size(); }
+    std::size_t get_instance_count() const { return instances.size(); }
+    void release_cpu_copies()
+    {
+        for (const auto& batch : batches)
+        {
+            batch.mesh->release_cpu_copy();
+        }
+    }
+
+    void init_rotation(const ShaderProgram& shader)
+    {
+        transform_index_location = shader.uniform("transformIndex");
+        view_projection_location = shader.uniform("viewProjection");
+        material_locations.init(shader);
+        shader.bind_uniform_block("Transforms", TRANSFORM_BLOCK_BINDING);
+    }
+    /* See Composition::get_color_bytes_saved */
+    std::size_t get_color_bytes_saved() const
+    {
+        std::size_t saved = 0;
+        for (const auto& batch : batches) { saved += batch.mesh->get_mesh()->get_color_bytes_saved(); }
+        return saved;
+    }
+    void set_view_projection(const glm::mat4& view_projection) { this->view_projection = view_projection; }
+    /* Culls back faces of the batches whose mesh is closed, false draws them regardless */
+    void set_face_culling(bool enabled) { face_culling = enabled; }
+    void apply_rotation(double elapsed_seconds)
+    {
+        transforms.set_rotation(transform_id, this->get_pivot(), this->get_angular_speed());
+        transforms.update(elapsed_seconds);
+        transforms.upload();
+    }
+
+    void draw_composition(const ShaderProgram& shader)
+    {
+        if (instances.empty()) { return; }
+        /* Only a change in the instance count re-creates the storage */
+        if (instance_buffer.get_size() != instances.size() * sizeof(InstanceData))
+        {
+            instance_buffer.resize(instances.size() * sizeof(InstanceData));
+            layout_buffer = 0;
+        }
+        instance_buffer.update(instances.data());
+
+        /* With base instance the section is selected per draw, otherwise the attributes follow the ring */
+        const bool base_instance = GLEW_ARB_base_instance;
+        std::size_t offset = base_instance ? 0 : instance_buffer.get_offset();
+        if (layout_buffer != instance_buffer.get_id() || layout_offset != offset)
+        {
+            for (const auto& batch : batches)
+            {
+                GLState::bind_vertex_array(batch.vao);
+                record_instance_layout(instance_buffer.get_id(), offset);
+            }
+            layout_buffer = instance_buffer.get_id();
+            layout_offset = offset;
+        }
+
+        shader.use();
+        GL_COUNTED(glUniformMatrix4fv(view_projection_location, 1, GL_FALSE, glm::value_ptr<float>(view_projection)));
+        GL_COUNTED(glUniform1i(transform_index_location, transforms.bind(transform_id)));
+        GLenum front = front_face_winding(view_projection);
+        for (const auto& batch : batches)
+        {
+            PAWN_CPU_SCOPE("draw_instanced");
+            PAWN_GL_SCOPE("draw_instanced");
+            GLState::set_face_culling(face_culling && batch.mesh->is_closed(), front);
+            const std::shared_ptr <Mesh>& mesh = batch.mesh->get_mesh();
+            mesh->stream();
+            GLState::bind_vertex_array(batch.vao);
+            material_locations.apply(batch.mesh->get_material());
+            GLsizei count = static_cast <GLsizei>(mesh->get_index_count()), instance_count = static_cast <GLsizei>(instances.size());
+            if (base_instance)
+            {
+                GL_COUNTED(glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0, instance_count, 
+                    mesh->get_base_vertex(), static_cast <GLuint>(instance_buffer.get_offset() / sizeof(InstanceData))));
+            }
+            else
+            {
+                GL_COUNTED(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0, instance_count, mesh->get_base_vertex()));
+            }
+            GLState::count_draw(mesh->get_index_count() / 3 * instances.size());
+        }
+    }
+
+    void random_pure_virtual_function() override { return; }
+
+    ~InstancedComposition()
+    {
+        for (auto& batch : batches)
+        {
+            GLState::forget_vertex_array(batch.vao);
+            glDeleteVertexArrays(1, &batch.vao);
+            delete batch.mesh;
+        }
+    }
+};
+
+/* Builds objects on worker threads without a GL context and uploads their meshes on the render thread.
+   Finished jobs reach the render thread through a lock-free list, pump() then uploads them under a time
+   budget and hands each job's objects to the scene only once every mesh they draw is on the GPU */
+class SceneLoader
+{
+public:
+    /* The objects one task built. add() lets helpers written for compositions, such as add_pawn, fill it */
+    struct Job
+    {
+        std::vector <Object3D*> objects;
+        std::vector <std::shared_ptr <Mesh>> uploads;
+        std::size_t uploaded = 0;
+        Job* next = nullptr;
+
+        void add(Object3D* obj) { objects.push_back(obj); }
+        template <class T, class... Args>
+        T& emplace(Args&&... args)
+        {
+            T* obj = new T(std::forward <Args>(args)...);
+            add(obj);
+            return *obj;
+        }
+    };
+private:
+    std::vector <std::thread> workers;
+    std::deque <std::function <void(Job&)>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    /* Pushed by workers, taken whole by the render thread, newest first */
+    std::atomic <Job*> finished{ nullptr };
+    /* Render thread only, oldest first */
+    std::deque <Job*> ready;
+    std::atomic <std::size_t> pending{ 0 };
+
+    void worker_loop()
+    {
+        while (true)
+        {
+            std::function <void(Job&)> task;
+            {
+                std::unique_lock <std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) { return; }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            Job* job = new Job();
+            deferred_uploads = &job->uploads;
+            task(*job);
+            deferred_uploads = nullptr;
+
+            job->next = finished.load(std::memory_order_relaxed);
+            while (!finished.compare_exchange_weak(job->next, job, std::memory_order_release, std::memory_order_relaxed)) {}
+        }
+    }
+    /* Meshes can be shared with a job that is still uploading, or still being built */
+    static bool is_uploaded(const Job& job)
+    {
+        for (const Object3D* obj : job.objects)
+        {
+            for (unsigned int level = 0; level < obj->get_lod_count(); ++level)
+            {
+                if (!obj->get_lod_mesh(level)->is_vao_init()) { return false; }
+            }
+        }
+        return true;
+    }
+public:
+    explicit SceneLoader(unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u))
+    {
+        for (unsigned int i = 0; i < threads; ++i) { workers.emplace_back(&SceneLoader::worker_loop, this); }
+    }
+    SceneLoader(const SceneLoader&) = delete;
+    SceneLoader& operator =(const SceneLoader&) = delete;
+
+    /* build runs on a worker and must not touch GL, constructing Object3Ds is fine */
+    void submit(std::function <void(Job&)> build)
+    {
+        ++pending;
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            tasks.push_back(std::move(build));
+        }
+        wake.notify_one();
+    }
+
+    /* Call on the render thread once per frame. Uploads for about budget_ms, at least one mesh per call, and
+       adds the objects of completed jobs to target. Returns the number of objects added */
+    template <class T>
+    std::size_t pump(T& target, double budget_ms)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed_ms = [&start]() { return std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+        Job* taken = finished.exchange(nullptr, std::memory_order_acquire);
+        std::size_t first = ready.size();
+        for (; taken; taken = taken->next) { ready.push_back(taken); }
+        std::reverse(ready.begin() + first, ready.end());
+
+        bool uploaded_any = false;
+        for (Job* job : ready)
+        {
+            while (job->uploaded < job->uploads.size() && (!uploaded_any || elapsed_ms() < budget_ms))
+            {
+                job->uploads[job->uploaded++]->upload();
+                uploaded_any = true;
+            }
+        }
+
+        std::size_t added = 0;
+        for (auto it = ready.begin(); it != ready.end();)
+        {
+            Job* job = *it;
+            if (job->uploaded < job->uploads.size() || !is_uploaded(*job))
+            {
+                ++it;
+                continue;
+            }
+            for (Object3D* obj : job->objects) { target.add(obj); }
+            added += job->objects.size();
+            delete job;
+            it = ready.erase(it);
+            --pending;
+        }
+        return added;
+    }
+    /* True once every submitted job has been handed to the scene */
+    bool is_idle() const { return pending == 0; }
+
+    ~SceneLoader()
+    {
+        {
+            std::lock_guard <std::mutex> lock(mutex);
+            stopping = true;
+            tasks.clear();
+        }
+        wake.notify_all();
+        for (auto& worker : workers) { worker.join(); }
+        for (Job* taken = finished.exchange(nullptr); taken; taken = taken->next) { ready.push_back(taken); }
+        for (Job* job : ready)
+        {
+            for (Object3D* obj : job->objects) { delete obj; }
+            delete job;
+        }
+    }
+};
+
+/* Previous push-per-vertex sphere generator, kept as the baseline for --bench-tessellation */
+void tessellate_sphere_reference(Mesh& mesh, float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality)
+{
+    for (unsigned int i = 0; i <= layer_quality; ++i)
+    {
+        for (unsigned int j = 0; j <= density_quality; ++j)
+        {
+            float vx = x + r * cosf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
+            float vy = y + r * sinf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI);
+            float vz = z + r * cosf(j / static_cast <float>(density_quality) * PI);
+            mesh.push_vertex(vx, vy, vz);
+        }
+    }
+
+    const unsigned int row = density_quality + 1;
+    for (unsigned int i = 0; i < layer_quality; ++i)
+    {
+        for (unsigned int j = 0; j < density_quality; ++j)
+        {
+            mesh.push_triangle(i * row + j, i * row + j + 1, (i + 1) * row + j);
+            mesh.push_triangle(i * row + j + 1, (i + 1) * row + j + 1, (i + 1) * row + j);
+        }
+    }
+}
+
+/* Prints sphere generation throughput (vertices/second) of the reference and the ring kernel */
+void run_tessellation_benchmark()
+{
+    for (unsigned int quality : { 32u, 128u, 512u, 2048u })
+    {
+        double seconds[2] = { 0.0, 0.0 };
+        std::size_t vertices = 0;
+        unsigned int repeats = std::max(1u, (1u << 22) / (quality * quality));
+        for (int kernel = 0; kernel < 2; ++kernel)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int repeat = 0; repeat < repeats; ++repeat)
+            {
+                Mesh mesh;
+                if (kernel == 0) { tessellate_sphere_reference(mesh, 0.0f, 0.0f, 0.0f, 1.0f, quality, quality); }
+                else { tessellate_sphere(mesh, 0.0f, 0.0f, 0.0f, 1.0f, quality, quality); }
+                vertices = mesh.get_vertex_count();
+            }
+            seconds[kernel] = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double reference = vertices * repeats / seconds[0], ring = vertices * repeats / seconds[1];
+        std::cout << "[Tessellation]: quality " << quality << ", " << vertices << " vertices: reference "
+            << reference << " vert/s, kernel " << ring << " vert/s (" << ring / reference << "x)" << std::endl;
+    }
+}
+
+/* Previous per-vertex color baking (copy of the vertices, then one set_color per vertex), baseline for --bench-colors */
+void bake_gradient_colors_reference(Mesh& mesh, const std::vector <float>& normalized_rgb)
+{
+    std::vector <Vertex> vertices = mesh.get_vertices();
+
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        float gradientFactor = glm::length(vertices[i].position) / glm::length(glm::vec3(1.0));
+
+        float r = normalized_rgb[0] * (1.0 - gradientFactor);
+        float g = normalized_rgb[1] * (1.0 - gradientFactor);
+        float b = normalized_rgb[2] * (1.0 - gradientFactor);
+
+        mesh.set_color(i, r, g, b);
+    }
+}
+
+/* Prints color baking throughput (vertices/second) of the reference and the batch pass */
+void run_color_benchmark()
+{
+    for (unsigned int quality : { 316u, 1000u, 2000u })
+    {
+        Mesh mesh;
+        tessellate_sphere(mesh, 0.0f, 0.0f, 0.0f, 1.0f, quality, quality);
+        double seconds[2] = { 0.0, 0.0 };
+        for (int kernel = 0; kernel < 2; ++kernel)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (kernel == 0) { bake_gradient_colors_reference(mesh, { 0.5f, 0.5f, 0.5f }); }
+            else { mesh.bake_gradient_colors({ 0.5f, 0.5f, 0.5f }); }
+            seconds[kernel] = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+        }
+        double reference = mesh.get_vertex_count() / seconds[0], batch = mesh.get_vertex_count() / seconds[1];
+        std::cout << "[Colors]: " << mesh.get_vertex_count() << " vertices: reference " << reference << " vert/s, batch " 
+            << batch << " vert/s (" << batch / reference << "x)" << std::endl;
+    }
+}
+
+/* Writes a unit sphere grid of 2 * quality^2 triangles as OBJ (quads with per-vertex normals) or binary PLY
+   (quads with normals and colors), a row at a time so generating large files stays cheap */
+bool write_import_test_file(const std::string& path, unsigned int quality, bool ply)
+{
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) { return false; }
+    const unsigned int row = quality + 1;
+    if (ply)
+    {
+        std::fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+            "property float nx\nproperty float ny\nproperty float nz\nproperty uchar red\nproperty uchar green\nproperty uchar blue\n"
+            "element face %u\nproperty list uchar int vertex_indices\nend_header\n", row * row, quality * quality);
+    }
+    for (unsigned int i = 0; i <= quality; ++i)
+    {
+        for (unsigned int j = 0; j <= quality; ++j)
+        {
+            float theta = 2 * PI * i / quality, phi = PI * j / quality;
+            float n[3] = { cosf(theta) * sinf(phi), sinf(theta) * sinf(phi), cosf(phi) };
+            if (ply)
+            {
+                unsigned char color[3] = { 200, 180, 160 };
+                std::fwrite(n, sizeof(float), 3, file);
+                std::fwrite(n, sizeof(float), 3, file);
+                std::fwrite(color, 1, 3, file);
+            }
+            else { std::fprintf(file, "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\n", n[0], n[1], n[2], n[0], n[1], n[2]); }
+        }
+    }
+    for (unsigned int i = 0; i < quality; ++i)
+    {
+        for (unsigned int j = 0; j < quality; ++j)
+        {
+            std::int32_t quad[4] = { static_cast <std::int32_t>(i * row + j), static_cast <std::int32_t>((i + 1) * row + j), 
+                static_cast <std::int32_t>((i + 1) * row + j + 1), static_cast <std::int32_t>(i * row + j + 1) };
+            if (ply)
+            {
+                unsigned char count = 4;
+                std::fwrite(&count, 1, 1, file);
+                std::fwrite(quad, sizeof(std::int32_t), 4, file);
+            }
+            else
+            {
+                std::fprintf(file, "f %d//%d %d//%d %d//%d %d//%d\n", quad[0] + 1, quad[0] + 1, quad[1] + 1, quad[1] + 1, 
+                    quad[2] + 1, quad[2] + 1, quad[3] + 1, quad[3] + 1);
+            }
+        }
+    }
+    return std::fclose(file) == 0;
+}
+
+/* Peak resident set size of the process in bytes, 0 where it is not available */
+unsigned long long peak_resident_bytes()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        return static_cast <unsigned long long>(usage.ru_maxrss);
+#else
+        return static_cast <unsigned long long>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+/* Parse throughput on generated 1M and 4M triangle files. The peak RSS is process-wide and only grows,
+   so files are parsed smallest first and the resulting mesh size is printed next to it */
+void run_import_benchmark()
+{
+    const double MB = 1024.0 * 1024.0;
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::vector <std::string> paths;
+    for (unsigned int quality : { 708u, 1415u })
+    {
+        for (bool ply : { true, false })
+        {
+            std::string path = (directory / ("pawn_import_" + std::to_string(quality) + (ply ? ".ply" : ".obj"))).string();
+            if (!write_import_test_file(path, quality, ply))
+            {
+                std::cout << "[Import]: Could not write " << path << std::endl;
+                return;
+            }
+            paths.push_back(path);
+        }
+    }
+    for (const std::string& path : paths)
+    {
+        ImportedMesh mesh;
+        auto start = std::chrono::steady_clock::now();
+        bool loaded = std::filesystem::path(path).extension() == ".ply" ? import_ply(path, mesh) : import_obj(path, mesh);
+        double seconds = std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+        if (loaded)
+        {
+            std::cout << "[Import]: " << std::filesystem::path(path).filename().string() << " " << mesh.bytes_read / MB << " MB, " 
+                << mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3 << " triangles: " << mesh.bytes_read / MB / seconds 
+                << " MB/s, peak RSS " << peak_resident_bytes() / MB << " MB (mesh " 
+                << (mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(unsigned int) + mesh.colors.size() * sizeof(glm::vec3)) / MB 
+                << " MB)" << std::endl;
+        }
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
+
+/* Builds the pawn out of primitives, usable with any composition that has emplace <T>() */
+template <class T>
+void add_pawn(T& comp, unsigned int quality = 20)
+{
+    const std::vector <float> gray = { 0.5f, 0.5f, 0.5f };
+    comp.template emplace <Sphere>(0.0f, 0.5f, 0.0f, 0.2f, quality, quality, gray, NULL_FLOAT_VECTOR);
+    comp.template emplace <StandingCylinder>(0.0f, 0.05f, 0.0f, 0.1f, 0.4f, quality, quality, gray, NULL_FLOAT_VECTOR);
+    comp.template emplace <StandingCylinder>(0.0f, 0.25f, 0.0f, 0.2f, 0.05f, quality, quality, gray, NULL_FLOAT_VECTOR);
+    comp.template emplace <StandingCylinder>(0.0f, -0.35f, 0.0f, 0.15f, 0.4f, quality, quality, gray, NULL_FLOAT_VECTOR);
+    comp.template emplace <StandingCylinder>(0.0f, -0.5f, 0.0f, 0.25f, 0.2f, quality, quality, gray, NULL_FLOAT_VECTOR);
+}
+
+/* Place of pawn index on a square board of pawns fitted into clip space, alternating light and dark pieces */
+struct BoardCell
+{
+    glm::vec3 position;
+    float scale;
+    glm::vec3 color;
+};
+BoardCell board_cell(unsigned int pawns, unsigned int index)
+{
+    unsigned int side = static_cast <unsigned int>(std::ceil(std::sqrt(static_cast <float>(pawns))));
+    float cell = 2.0f / side;
+    unsigned int row = index / side, column = index % side;
+    return { glm::vec3(-1.0f + cell * (column + 0.5f), -1.0f + cell * (row + 0.5f), 0.0f), cell * 0.5f, 
+        (row + column) % 2 == 0 ? glm::vec3(1.0f) : glm::vec3(0.35f) };
+}
+
+/* Lays out the board of board_cell() as instances */
+void add_pawn_board(InstancedComposition& board, unsigned int pawns)
+{
+    for (unsigned int i = 0; i < pawns; ++i)
+    {
+        BoardCell cell = board_cell(pawns, i);
+        glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1), cell.position), glm::vec3(cell.scale));
+        board.add_instance(transform, cell.color);
+    }
+}
+
+/* Creates the GL context: a visible window, or for headless runs a hidden window on the null platform
+   with an OSMesa context (GLFW 3.4+) or on an EGL context, so no display server is required */
+GLFWwindow* create_context(bool headless)
+{
+#ifdef GLFW_PLATFORM_NULL
+    if (headless) { glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL); }
+#endif
+    if (!glfwInit())
+    {
+        std::cout << "[GLFW]: Initialization Error!\n";
+        return nullptr;
+    }
+    if (headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+    }
+    GLFWwindow* window = glfwCreateWindow(640, 640, "GLFW", NULL, NULL);
+    if (!window)
+    {
+        std::cout << "[GLFW]: Window Creation Error!\n";
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    /* GLX builds of GLEW report this for EGL/OSMesa contexts even though the entry points load fine */
+    if (headless && status == GLEW_ERROR_NO_GLX_DISPLAY) { status = GLEW_OK; }
+#endif
+    if (status != GLEW_OK)
+    {
+        std::cout << "[GLEW]: Initialization Error!\n";
+        glfwTerminate();
+        return nullptr;
+    }
+    std::cout << glGetString(GL_VERSION) << std::endl;
+    return window;
+}
+
+/* Color + depth render target, lets frames be rendered without presenting to a window */
+class OffscreenTarget
+{
+private:
+    unsigned int fbo = 0, color = 0, depth = 0;
+    int width, height;
+public:
+    OffscreenTarget(int width, int height) : width(width), height(height)
+    {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "[GL]: Offscreen framebuffer is incomplete!\n";
+        }
+        glViewport(0, 0, width, height);
+    }
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator =(const OffscreenTarget&) = delete;
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    /* RGBA, rows bottom to top */
+    std::vector <unsigned char> read_color() const
+    {
+        std::vector <unsigned char> pixels(static_cast <std::size_t>(width) * height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+    /* One byte per pixel, rows bottom to top */
+    std::vector <unsigned char> read_stencil() const
+    {
+        std::vector <unsigned char> stencil(static_cast <std::size_t>(width) * height);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, stencil.data());
+        return stencil;
+    }
+
+    ~OffscreenTarget()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+};
+
+/* What a headless run renders: N non-instanced pawns, or an instanced board of N pawns */
+struct SceneConfig
+{
+    unsigned int pawns = 1;
+    unsigned int quality = 20;
+    bool instanced = false;
+    unsigned int frames = 300;
+    /* When non-zero, non-instanced pawns are spread on a square grid with this spacing, mostly off-screen */
+    float spacing = 0.0f;
+    /* When non-zero, the grid is viewed in perspective from this far in front of its center instead of in clip space */
+    float camera_distance = 0.0f;
+    /* Draws the non-instanced scene through Composition::bake() */
+    bool baked = false;
+    /* Fraction of instances recolored every frame, exercising partial instance buffer updates */
+    float recolor = 0.0f;
+    /* When non-zero, the non-instanced scene is recorded on this many threads, see Composition::set_recording_pool() */
+    unsigned int threads = 0;
+    /* Tilts the perspective camera by this many degrees from the grid's normal, so pawns of later rows hide behind earlier ones */
+    float camera_tilt = 0.0f;
+    bool cull_back_faces = true;
+    DrawOrder order = DrawOrder::FRONT_TO_BACK;
+    bool depth_prepass = false;
+    /* Counts the fragments that pass the depth test per pixel of the last frame in the stencil buffer */
+    bool overdraw = false;
+    /* Lays the non-instanced pawns out on the board of board_cell() at full detail, the per-object twin of the
+       instanced board. Pawns rotate on their own, so only the first frame matches the board */
+    bool board_layout = false;
+    /* Reads the color buffer of the last frame into FrameStats::pixels */
+    bool keep_pixels = false;
+};
+
+struct FrameStats
+{
+    std::vector <double> cpu_ms;
+    std::vector <double> gpu_ms;
+    unsigned long long gl_calls = 0;
+    unsigned long long draw_calls = 0;
+    unsigned long long triangles = 0;
+    LodStats lods;
+    std::size_t color_bytes_saved = 0;
+    /* Of the last frame when SceneConfig::overdraw is set. Counts saturate at 255 per pixel */
+    unsigned long long shaded_fragments = 0;
+    unsigned long long covered_pixels = 0;
+    unsigned int max_overdraw = 0;
+    /* RGBA of the last frame when SceneConfig::keep_pixels is set, rows bottom to top */
+    std::vector <unsigned char> pixels;
+};
+
+/* Renders config.frames frames offscreen. CPU time covers issuing the frame, GPU time comes from
+   GL_TIME_ELAPSED queries read back a few frames later so the pipeline is never stalled */
+FrameStats render_offscreen(const ShaderProgramInfo& source, const SceneConfig& config)
+{
+    const unsigned int QUERIES = 4;
+    FrameStats stats;
+    GLState::invalidate();
+    OffscreenTarget target(640, 640);
+    glEnable(GL_DEPTH_TEST);
+    if (config.overdraw)
+    {
+        /* Every fragment that passes the depth test increments its pixel */
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    }
+
+    std::unique_ptr <WorkStealingPool> pool;
+    if (config.threads > 0) { pool = std::make_unique <WorkStealingPool>(config.threads); }
+    Composition comp;
+    comp.set_recording_pool(pool.get());
+    InstancedComposition board;
+    if (config.instanced)
+    {
+        add_pawn(board, config.quality);
+        add_pawn_board(board, config.pawns);
+    }
+    else
+    {
+        for (unsigned int i = 0; i < config.pawns; ++i) { add_pawn(comp, config.quality); }
+        if (config.board_layout)
+        {
+            TransformSystem& transforms = comp.get_transforms();
+            for (std::size_t i = 0; i < comp.get_figure_count(); ++i)
+            {
+                /* Five figures per pawn, the instance color multiplies the material like the instance attribute does */
+                BoardCell cell = board_cell(config.pawns, static_cast <unsigned int>(i / 5));
+                std::size_t id = comp.get_transform_id(i);
+                transforms.set_position(id, cell.position);
+                transforms.set_scale(id, glm::vec3(cell.scale));
+                Material material = comp.get_figure(i).get_material();
+                material.color = material.color * cell.color;
+                comp.get_figure(i).set_material(material);
+            }
+            comp.mark_transforms_changed();
+            /* The instanced board has no detail levels */
+            comp.set_viewport_height(1e6f);
+        }
+        else if (config.spacing > 0.0f)
+        {
+            /* add_pawn adds five figures per pawn, each with its own transform in insertion order */
+            unsigned int side = static_cast <unsigned int>(std::ceil(std::sqrt(static_cast <float>(config.pawns))));
+            TransformSystem& transforms = comp.get_transforms();
+            for (std::size_t i = 0; i < transforms.size(); ++i)
+            {
+                unsigned int pawn = static_cast <unsigned int>(i / 5);
+                transforms.set_position(i, glm::vec3((pawn % side) * config.spacing, (pawn / side) * config.spacing, 0.0f));
+            }
+            comp.mark_transforms_changed();
+            if (config.camera_distance > 0.0f)
+            {
+                glm::vec3 center = glm::vec3((side - 1) * config.spacing * 0.5f, (side - 1) * config.spacing * 0.5f, 0.0f);
+                float tilt = glm::radians(config.camera_tilt);
+                glm::vec3 eye = center + config.camera_distance * glm::vec3(0.0f, -std::sin(tilt), std::cos(tilt));
+                glm::mat4 view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+                comp.set_view_projection(glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, config.camera_distance * 4.0f) * view);
+            }
+        }
+    }
+    if (config.baked) { comp.bake(); }
+    comp.set_draw_order(config.order);
+    comp.set_face_culling(config.cull_back_faces);
+    board.set_face_culling(config.cull_back_faces);
+    /* Built here for a single run, a suite keeps it alive across its runs (see run_scenes()) */
+    std::shared_ptr <ShaderProgram> program = ShaderManager::instance().create(source);
+    const ShaderProgram& shader = *program;
+    comp.init_rotation(shader);
+    if (config.depth_prepass) { comp.set_depth_prepass(ShaderManager::instance().create(depth_only(source))); }
+    board.init_rotation(shader);
+    init_instance_attribute_defaults();
+
+    unsigned int queries[QUERIES];
+    glGenQueries(QUERIES, queries);
+    auto read_query = [&](unsigned int query)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        stats.gpu_ms.push_back(elapsed / 1e6);
+    };
+
+    for (unsigned int frame = 0; frame < config.frames; ++frame)
+    {
+        if (frame >= QUERIES) { read_query(queries[frame % QUERIES]); }
+        PAWN_PROFILE_END_FRAME();
+        PAWN_CPU_SCOPE("frame");
+        auto start = std::chrono::steady_clock::now();
+        GLState::reset_frame_stats();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % QUERIES]);
+
+        GL_COUNTED(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | (config.overdraw ? GL_STENCIL_BUFFER_BIT : 0)));
+        GL_COUNTED(glClearColor(1, 1, 1, 1));
+        /* Fixed 60 Hz timeline so runs are reproducible */
+        double elapsed = frame / 60.0;
+        if (config.instanced)
+        {
+            std::size_t recolored = static_cast <std::size_t>(config.recolor * board.get_instance_count());
+            for (std::size_t i = 0; i < recolored; ++i)
+            {
+                std::size_t index = (static_cast <std::size_t>(frame) * recolored + i) % board.get_instance_count();
+                board.set_instance(index, board.get_instance(index).transform, glm::vec3(0.5f + 0.5f * std::sin(static_cast <float>(elapsed + index))));
+            }
+            board.apply_rotation(elapsed);
+            board.draw_composition(shader);
+        }
+        else
+        {
+            comp.apply_rotation(elapsed);
+            comp.draw_composition(shader);
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
+        stats.cpu_ms.push_back(std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        stats.gl_calls = GLState::get_calls();
+        stats.draw_calls = GLState::get_draw_calls();
+        stats.triangles = GLState::get_triangles();
+        stats.lods = comp.get_lod_stats();
+    }
+    for (unsigned int frame = config.frames > QUERIES ? config.frames - QUERIES : 0; frame < config.frames; ++frame)
+    {
+        read_query(queries[frame % QUERIES]);
+    }
+    glDeleteQueries(QUERIES, queries);
+    stats.color_bytes_saved = config.instanced ? board.get_color_bytes_saved() : comp.get_color_bytes_saved();
+    if (config.keep_pixels) { stats.pixels = target.read_color(); }
+    if (config.overdraw)
+    {
+        for (unsigned char count : target.read_stencil())
+        {
+            stats.shaded_fragments += count;
+            stats.covered_pixels += count != 0;
+            stats.max_overdraw = std::max <unsigned int>(stats.max_overdraw, count);
+        }
+        glDisable(GL_STENCIL_TEST);
+    }
+    return stats;
+}
+
+/* One JSON object per run, so CI can diff results against a stored baseline */
+void print_frame_report(std::ostream& out, const std::string& name, const SceneConfig& config, const FrameStats& stats)
+{
+    double cpu_mean = 0.0, gpu_mean = 0.0;
+    for (double ms : stats.cpu_ms) { cpu_mean += ms; }
+    for (double ms : stats.gpu_ms) { gpu_mean += ms; }
+    cpu_mean /= std::max<std::size_t>(stats.cpu_ms.size(), 1);
+    gpu_mean /= std::max<std::size_t>(stats.gpu_ms.size(), 1);
+
+    out << "{\"name\": \"" << name << "\", \"pawns\": " << config.pawns << ", \"quality\": " << config.quality
+        << ", \"instanced\": " << (config.instanced ? "true" : "false") << ", \"baked\": " << (config.baked ? "true" : "false")
+        << ", \"recolor\": " << config.recolor << ", \"threads\": " << config.threads
+        << ", \"cull_back_faces\": " << (config.cull_back_faces ? "true" : "false")
+        << ", \"front_to_back\": " << (config.order == DrawOrder::FRONT_TO_BACK ? "true" : "false")
+        << ", \"depth_prepass\": " << (config.depth_prepass ? "true" : "false")
+        << ", \"frames\": " << config.frames
+        << ", \"cpu_ms_mean\": " << cpu_mean << ", \"cpu_ms_p50\": " << percentile(stats.cpu_ms, 0.5)
+        << ", \"cpu_ms_p99\": " << percentile(stats.cpu_ms, 0.99)
+        << ", \"gpu_ms_mean\": " << gpu_mean << ", \"gpu_ms_p50\": " << percentile(stats.gpu_ms, 0.5)
+        << ", \"gpu_ms_p99\": " << percentile(stats.gpu_ms, 0.99)
+        << ", \"gl_calls\": " << stats.gl_calls << ", \"draw_calls\": " << stats.draw_calls
+        << ", \"triangles\": " << stats.triangles << ", \"color_bytes_saved\": " << stats.color_bytes_saved;
+    if (config.overdraw)
+    {
+        /* Shaded fragments per covered pixel, 1 means no fragment was shaded only to be overwritten */
+        out << ", \"shaded_fragments\": " << stats.shaded_fragments << ", \"covered_pixels\": " << stats.covered_pixels
+            << ", \"overdraw\": " << static_cast <double>(stats.shaded_fragments) / std::max(stats.covered_pixels, 1ull)
+            << ", \"overdraw_max\": " << stats.max_overdraw;
+    }
+    out << ", \"lod_objects\": [";
+    for (unsigned int level = 0; level < LOD_LEVELS; ++level) { out << (level ? ", " : "") << stats.lods.objects[level]; }
+    out << "], \"lod_triangles_saved\": [";
+    for (unsigned int level = 0; level < LOD_LEVELS; ++level) { out << (level ? ", " : "") << stats.lods.triangles_saved[level]; }
+    out << "]}";
+}
+
+/* Writes a JSON array of frame reports, one per run */
+void run_scenes(const ShaderProgramInfo& source, const std::vector <std::pair <std::string, SceneConfig>>& runs, std::ostream& out)
+{
+    /* ShaderManager only keeps weak references, holding the programs here lets every run find them instead of building them again */
+    std::shared_ptr <ShaderProgram> program = ShaderManager::instance().create(source);
+    std::shared_ptr <ShaderProgram> depth_program;
+    if (std::any_of(runs.begin(), runs.end(), [](const auto& run) { return run.second.depth_prepass; }))
+    {
+        depth_program = ShaderManager::instance().create(depth_only(source));
+    }
+    out << "[\n";
+    for (std::size_t i = 0; i < runs.size(); ++i)
+    {
+        FrameStats stats = render_offscreen(source, runs[i].second);
+        out << "  ";
+        print_frame_report(out, runs[i].first, runs[i].second, stats);
+        out << (i + 1 < runs.size() ? ",\n" : "\n");
+    }
+    out << "]" << std::endl;
+}
+
+/* Overdraw of a grid seen at a grazing angle, pawns of each row partly hidden behind the row in front: without
+   culling in state order, with back faces culled, front-to-back and front-to-back after a depth pre-pass */
+void run_overdraw_benchmark(const ShaderProgramInfo& source, unsigned int frames, std::ostream& out)
+{
+    SceneConfig scene = { 400, 20, false, frames, 0.5f, 12.0f };
+    scene.camera_tilt = 70.0f;
+    scene.overdraw = true;
+    std::vector <std::pair <std::string, SceneConfig>> runs;
+    SceneConfig config = scene;
+    config.cull_back_faces = false;
+    config.order = DrawOrder::STATE;
+    runs.push_back({ "overdraw_no_culling", config });
+    config.cull_back_faces = true;
+    runs.push_back({ "overdraw_culled", config });
+    config.order = DrawOrder::FRONT_TO_BACK;
+    runs.push_back({ "overdraw_front_to_back", config });
+    config.depth_prepass = true;
+    runs.push_back({ "overdraw_depth_prepass", config });
+    run_scenes(source, runs, out);
+}
+
+/* Scales object count and tessellation quality, writes a JSON array of frame reports */
+void run_frame_benchmark(const ShaderProgramInfo& source, unsigned int frames, std::ostream& out)
+{
+    std::vector <std::pair <std::string, SceneConfig>> runs;
+    for (unsigned int pawns : { 1u, 10u, 100u, 1000u })
+    {
+        runs.push_back({ "objects", { pawns, 20, false, frames } });
+    }
+    /* 1k, 10k and 100k figures through the render queue, coarse meshes so CPU submission dominates */
+    for (unsigned int pawns : { 200u, 2000u, 20000u })
+    {
+        runs.push_back({ "queue", { pawns, 8, false, frames } });
+    }
+    for (unsigned int quality : { 8u, 20u, 64u, 256u })
+    {
+        runs.push_back({ "quality", { 10, quality, false, frames } });
+    }
+    for (unsigned int pawns : { 100u, 10000u })
+    {
+        runs.push_back({ "instanced", { pawns, 20, true, frames } });
+    }
+    /* 1% of the instances change color every frame */
+    runs.push_back({ "recolor", { 10000, 20, true, frames, 0.0f, 0.0f, false, 0.01f } });
+    /* Same object count as the largest "objects" run, but only a corner of the grid is on screen */
+    runs.push_back({ "culled", { 1000, 20, false, frames, 0.5f } });
+    /* The whole grid in perspective, distant pawns drop to coarser levels */
+    runs.push_back({ "lod", { 1000, 64, false, frames, 0.5f, 20.0f } });
+    /* Same scenes as "objects", each pawn merged into one multi-draw */
+    for (unsigned int pawns : { 100u, 1000u })
+    {
+        runs.push_back({ "baked", { pawns, 20, false, frames, 0.0f, 0.0f, true } });
+    }
+    /* The 100k figure "queue" scene recorded in parallel, doubling the threads up to the hardware's */
+    unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardware))
+    {
+        runs.push_back({ "recorded", { 20000, 8, false, frames, 0.0f, 0.0f, false, 0.0f, threads } });
+        if (threads == hardware) { break; }
+    }
+    run_scenes(source, runs, out);
+}
+
+/* Time to build and upload one pawn: generated with no cache directory, cold (generated and written to an empty
+   directory) and warm (mapped from the files the cold run wrote). Warm runs read through the OS page cache */
+void run_startup_benchmark(std::ostream& out)
+{
+    const unsigned int REPEATS = 5;
+    std::string directory = (std::filesystem::temp_directory_path() / "pawn_mesh_cache_benchmark").string();
+    std::string previous = MeshCache::instance().get_directory();
+    auto time_pawn = [](const std::string& directory, unsigned int quality)
+    {
+        MeshCache::instance().set_directory(directory);
+        auto start = std::chrono::steady_clock::now();
+        {
+            /* The composition drops its meshes on destruction, so every build misses the in-memory cache */
+            Composition comp;
+            add_pawn(comp, quality);
+            glFinish();
+        }
+        return std::chrono::duration <double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    out << "[\n";
+    const unsigned int QUALITIES[] = { 20, 64, 256 };
+    for (unsigned int q = 0; q < 3; ++q)
+    {
+        unsigned int quality = QUALITIES[q];
+        std::vector <double> generated, cold, warm;
+        for (unsigned int repeat = 0; repeat < REPEATS; ++repeat)
+        {
+            std::error_code error;
+            std::filesystem::remove_all(directory, error);
+            generated.push_back(time_pawn("", quality));
+            cold.push_back(time_pawn(directory, quality));
+            warm.push_back(time_pawn(directory, quality));
+        }
+        out << "  {\"name\": \"startup\", \"quality\": " << quality << ", \"generated_ms_p50\": " << percentile(generated, 0.5) 
+            << ", \"cold_ms_p50\": " << percentile(cold, 0.5) << ", \"warm_ms_p50\": " << percentile(warm, 0.5) << "}" 
+            << (q + 1 < 3 ? ",\n" : "\n");
+    }
+    out << "]" << std::endl;
+
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+    MeshCache::instance().set_directory(previous);
+}
+
+/* Builds pawns of distinct qualities, so every mesh is generated, once serially on the render thread and once through
+   a SceneLoader pumped with a 2 ms budget per frame. The longest frame is how long the render loop stalls */
+void run_construction_benchmark(std::ostream& out)
+{
+    const unsigned int PAWNS = 64, BASE_QUALITY = 128;
+    const double BUDGET_MS = 2.0;
+    std::string previous = MeshCache::instance().get_directory();
+    MeshCache::instance().set_directory("");
+    auto now = std::chrono::steady_clock::now;
+    auto milliseconds = [](auto duration) { return std::chrono::duration <double, std::milli>(duration).count(); };
+
+    double serial_ms = 0.0;
+    {
+        Composition comp;
+        auto start = now();
+        for (unsigned int i = 0; i < PAWNS; ++i) { add_pawn(comp, BASE_QUALITY + i); }
+        glFinish();
+        serial_ms = milliseconds(now() - start);
+    }
+
+    double threaded_ms = 0.0, longest_frame_ms = 0.0;
+    unsigned int frames = 0, threads = std::max(std::thread::hardware_concurrency(), 1u);
+    {
+        Composition comp;
+        SceneLoader loader(threads);
+        auto start = now();
+        /* Offset past the serial run's qualities, its meshes are gone but the keys would be identical */
+        for (unsigned int i = 0; i < PAWNS; ++i)
+        {
+            unsigned int quality = BASE_QUALITY + PAWNS + i;
+            loader.submit([quality](SceneLoader::Job& job) { add_pawn(job, quality); });
+        }
+        while (!loader.is_idle())
+        {
+            auto frame_start = now();
+            loader.pump(comp, BUDGET_MS);
+            glFinish();
+            longest_frame_ms = std::max(longest_frame_ms, milliseconds(now() - frame_start));
+            ++frames;
+        }
+        threaded_ms = milliseconds(now() - start);
+    }
+    MeshCache::instance().set_directory(previous);
+
+    out << "{\"name\": \"construction\", \"pawns\": " << PAWNS << ", \"threads\": " << threads << ", \"serial_ms\": " << serial_ms 
+        << ", \"threaded_ms\": " << threaded_ms << ", \"frames\": " << frames << ", \"longest_frame_ms\": " << longest_frame_ms 
+        << ", \"budget_ms\": " << BUDGET_MS << "}" << std::endl;
+}
+
+/* The generators from before indexing, unchanged: one position per triangle corner, in their order and winding */
+void expand_sphere_reference(std::vector <glm::vec3>& corners, float x, float y, float z, float r, unsigned int layer_quality, unsigned int density_quality)
+{
+    auto point = [&](unsigned int i, unsigned int j)
+    {
+        return glm::vec3(x + r * cosf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI),
+            y + r * sinf(2 * PI * i / static_cast <float>(layer_quality)) * sinf(j / static_cast <float>(density_quality) * PI),
+            z + r * cosf(j / static_cast <float>(density_quality) * PI));
+    };
+    for (unsigned int i = 0; i < layer_quality; ++i)
+    {
+        for (unsigned int j = 0; j < density_quality; ++j)
+        {
+            corners.insert(corners.end(), { point(i, j), point(i + 1, j), point(i, j + 1) });
+            corners.insert(corners.end(), { point(i, j), point(i + 1, j), point(i + 1, j + 1) });
+        }
+    }
+}
+void expand_cylinder_reference(std::vector <glm::vec3>& corners, float bx, float by, float bz, float r, float h, unsigned int circle_quality, unsigned int side_quality)
+{
+    auto ring = [&](unsigned int i, unsigned int quality, float y)
+    {
+        return glm::vec3(bx + r * cosf(2.0f * PI * static_cast <float>(i) / static_cast <float>(quality)), y, 
+            bz + r * sinf(2.0f * PI * static_cast <float>(i) / static_cast <float>(quality)));
+    };
+    for (unsigned int i = 0; i < circle_quality; ++i)
+    {
+        corners.insert(corners.end(), { ring(i, circle_quality, by), ring(i + 1, circle_quality, by), glm::vec3(bx, by, bz) });
+    }
+    for (unsigned int i = 0; i < circle_quality; ++i)
+    {
+        corners.insert(corners.end(), { ring(i, circle_quality, by + h), ring(i + 1, circle_quality, by + h), glm::vec3(bx, by + h, bz) });
+    }
+    for (unsigned int i = 0; i < side_quality; ++i)
+    {
+        corners.insert(corners.end(), { ring(i, side_quality, by), ring(i + 1, side_quality, by), ring(i, side_quality, by + h) });
+        corners.insert(corners.end(), { ring(i + 1, side_quality, by), ring(i + 1, side_quality, by + h), ring(i, side_quality, by + h) });
+    }
+}
+
+/* Compares the triangles of mesh with the expanded corners as unordered sets, ignoring winding: the indexed
+   generators emit triangles in another order and wind every one counter-clockwise from outside */
+bool check_expanded(const std::string& name, const Mesh& mesh, const std::vector <glm::vec3>& expected)
+{
+    const float TOLERANCE = 1e-5f;
+    struct Triangle
+    {
+        glm::vec3 corners[3];
+        /* Sort key, close for triangles that may match */
+        float key;
+        bool matched;
+    };
+    auto make_triangle = [](const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        return Triangle{ { a, b, c }, a.x + b.x + c.x, false };
+    };
+    auto same_corners = [TOLERANCE](const Triangle& a, const Triangle& b)
+    {
+        static const unsigned int PERMUTATIONS[6][3] = { { 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 0, 2, 1 }, { 2, 1, 0 }, { 1, 0, 2 } };
+        for (const auto& permutation : PERMUTATIONS)
+        {
+            bool same = true;
+            for (unsigned int k = 0; same && k < 3; ++k) { same = glm::length(a.corners[k] - b.corners[permutation[k]]) <= TOLERANCE; }
+            if (same) { return true; }
+        }
+        return false;
+    };
+
+    std::vector <Triangle> reference;
+    for (std::size_t i = 0; i + 2 < expected.size(); i += 3) { reference.push_back(make_triangle(expected[i], expected[i + 1], expected[i + 2])); }
+    std::sort(reference.begin(), reference.end(), [](const Triangle& a, const Triangle& b) { return a.key < b.key; });
+
+    const std::vector <Vertex>& vertices = mesh.get_vertices();
+    const std::vector <unsigned int>& indices = mesh.get_indices();
+    std::size_t unmatched = 0;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        Triangle triangle = make_triangle(vertices[indices[i]].position, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
+        auto candidate = std::lower_bound(reference.begin(), reference.end(), triangle.key - 3.0f * TOLERANCE, 
+            [](const Triangle& a, float key) { return a.key < key; });
+        for (; candidate != reference.end() && candidate->key <= triangle.key + 3.0f * TOLERANCE; ++candidate)
+        {
+            if (!candidate->matched && same_corners(*candidate, triangle)) { break; }
+        }
+        if (candidate == reference.end() || candidate->key > triangle.key + 3.0f * TOLERANCE) { ++unmatched; }
+        else { candidate->matched = true; }
+    }
+    bool passed = indices.size() == expected.size() && unmatched == 0;
+    std::cout << "[SelfTest]: " << name << ": " << indices.size() / 3 << " triangles, " << expected.size() / 3 << " expected, " 
+        << unmatched << " unmatched" << (passed ? "" : ", FAILED") << std::endl;
+    return passed;
+}
+
+/* Every edge of a closed mesh borders exactly two triangles running along it in opposite directions. Seams and
+   poles repeat positions under different indices, so vertices are welded by position first */
+bool check_closed(const std::string& name, const Mesh& mesh)
+{
+    const std::vector <Vertex>& vertices = mesh.get_vertices();
+    const std::vector <unsigned int>& indices = mesh.get_indices();
+    std::vector <unsigned int> weld(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); ++i)
+    {
+        weld[i] = i;
+        for (unsigned int j = 0; j < i; ++j)
+        {
+            if (weld[j] == j && glm::length(vertices[i].position - vertices[j].position) <= 1e-5f)
+            {
+                weld[i] = j;
+                break;
+            }
+        }
+    }
+    /* Directed edge to the number of triangles running along it */
+    std::map <std::pair <unsigned int, unsigned int>, unsigned int> edges;
+    std::size_t degenerate = 0;
+    for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        unsigned int corners[3] = { weld[indices[t]], weld[indices[t + 1]], weld[indices[t + 2]] };
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+        {
+            ++degenerate;
+            continue;
+        }
+        for (unsigned int k = 0; k < 3; ++k) { ++edges[{ corners[k], corners[(k + 1) % 3] }]; }
+    }
+    std::size_t unmatched = 0;
+    for (const auto& edge : edges)
+    {
+        auto reverse = edges.find({ edge.first.second, edge.first.first });
+        if (edge.second != 1 || reverse == edges.end() || reverse->second != 1) { ++unmatched; }
+    }
+    bool passed = !edges.empty() && unmatched == 0;
+    std::cout << "[SelfTest]: " << name << " closed: " << edges.size() / 2 << " edges, " << unmatched << " unmatched, " 
+        << degenerate << " degenerate triangles" << (passed ? "" : ", FAILED") << std::endl;
+    return passed;
+}
+
+/* The indexed sphere and cylinder cover exactly the triangles of the expanded generators, up to the sphere fix
+   below, and are closed */
+unsigned int check_generators()
+{
+    unsigned int failures = 0;
+    for (unsigned int quality : { 3u, 8u, 20u, 64u })
+    {
+        Mesh sphere;
+        tessellate_sphere(sphere, 0.0f, 0.5f, 0.0f, 0.2f, quality, quality + 1);
+        std::vector <glm::vec3> expected;
+        expand_sphere_reference(expected, 0.0f, 0.5f, 0.0f, 0.2f, quality, quality + 1);
+        /* Intended difference: the expanded sphere's second triangle of each quad, (x1, x2, x4), overlapped the first,
+           (x1, x2, x3), and left the (x3, x4, x2) half of the quad open. The indexed sphere fills that hole */
+        for (std::size_t quad = 0; quad < expected.size(); quad += 6)
+        {
+            glm::vec3 x2 = expected[quad + 1], x3 = expected[quad + 2], x4 = expected[quad + 5];
+            expected[quad + 3] = x3;
+            expected[quad + 4] = x4;
+            expected[quad + 5] = x2;
+        }
+        failures += !check_expanded("sphere " + std::to_string(quality), sphere, expected);
+        failures += !check_closed("sphere " + std::to_string(quality), sphere);
+
+        Mesh cylinder;
+        tessellate_standing_cylinder(cylinder, 0.0f, -0.35f, 0.0f, 0.15f, 0.4f, quality, quality + 2);
+        expected.clear();
+        expand_cylinder_reference(expected, 0.0f, -0.35f, 0.0f, 0.15f, 0.4f, quality, quality + 2);
+        failures += !check_expanded("cylinder " + std::to_string(quality), cylinder, expected);
+
+        /* Caps and side only meet edge to edge when their rings match */
+        Mesh matched;
+        tessellate_standing_cylinder(matched, 0.0f, -0.35f, 0.0f, 0.15f, 0.4f, quality, quality);
+        failures += !check_closed("cylinder " + std::to_string(quality), matched);
+    }
+    return failures;
+}
+
+/* Renders the queued, baked, recorded and instanced paths offscreen. Once warmed up, their frames must not touch the
+   heap, on the pool threads either. Recording needs GL_ARB_base_instance, without it that composition is queued too */
+unsigned int check_allocations(const ShaderProgramInfo& source, unsigned int frames)
+{
+#ifdef PAWN_COUNT_ALLOCATIONS
+    /* The first frames may still allocate inside the driver and fill the render queues */
+    const unsigned int WARMUP_FRAMES = 3;
+    GLState::invalidate();
+    OffscreenTarget target(64, 64);
+    glEnable(GL_DEPTH_TEST);
+    Composition queued, baked, recorded;
+    WorkStealingPool pool(2);
+    recorded.set_recording_pool(&pool);
+    InstancedComposition board;
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        add_pawn(queued, 8);
+        add_pawn(baked, 8);
+        add_pawn(recorded, 8);
+    }
+    baked.bake();
+    add_pawn(board, 8);
+    add_pawn_board(board, 16);
+    std::shared_ptr <ShaderProgram> program = ShaderManager::instance().create(source);
+    queued.init_rotation(*program);
+    baked.init_rotation(*program);
+    recorded.init_rotation(*program);
+    board.init_rotation(*program);
+    init_instance_attribute_defaults();
+
+    unsigned long long allocations = 0;
+    for (unsigned int frame = 0; frame < WARMUP_FRAMES + frames; ++frame)
+    {
+        unsigned long long allocations_before = heap_allocations;
+        double elapsed = frame / 60.0;
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        queued.apply_rotation(elapsed);
+        queued.draw_composition(*program);
+        baked.apply_rotation(elapsed);
+        baked.draw_composition(*program);
+        recorded.apply_rotation(elapsed);
+        recorded.draw_composition(*program);
+        board.apply_rotation(elapsed);
+        board.draw_composition(*program);
+        if (frame >= WARMUP_FRAMES) { allocations += heap_allocations - allocations_before; }
+    }
+    bool passed = allocations == 0;
+    std::cout << "[SelfTest]: allocations: " << allocations << " heap allocations in " << frames << " steady-state frames" 
+        << (passed ? "" : ", FAILED") << std::endl;
+    return passed ? 0 : 1;
+#else
+    (void)source;
+    (void)frames;
+    std::cout << "[SelfTest]: allocations: skipped, build with -DPAWN_COUNT_ALLOCATIONS to count them" << std::endl;
+    return 0;
+#endif
+}
+
+/* True when all 8 corners of box lie beyond the same clip-space plane, without Frustum and its extracted planes */
+bool outside_clip_space(const Bounds& box, const glm::mat4& view_projection)
+{
+    glm::vec4 clip[8];
+    for (unsigned int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec3 point(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z);
+        clip[corner] = view_projection * glm::vec4(point, 1.0f);
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (float side : { -1.0f, 1.0f })
+        {
+            bool outside = true;
+            for (unsigned int corner = 0; outside && corner < 8; ++corner) { outside = side * clip[corner][axis] > clip[corner].w; }
+            if (outside) { return true; }
+        }
+    }
+    return false;
+}
+
+/* Composition::cull() through the BVH returns exactly the figures a clip-space test of every figure's corners keeps,
+   for a few cameras and after the transforms move. Two cameras also have a known answer: all figures, or none */
+unsigned int check_culling()
+{
+    const unsigned int SIDE = 12;
+    const float SPACING = 0.5f;
+    Composition comp;
+    for (unsigned int i = 0; i < SIDE * SIDE; ++i) { add_pawn(comp, 8); }
+    TransformSystem& transforms = comp.get_transforms();
+    for (std::size_t i = 0; i < transforms.size(); ++i)
+    {
+        unsigned int pawn = static_cast <unsigned int>(i / 5);
+        transforms.set_position(i, glm::vec3((pawn % SIDE) * SPACING, (pawn / SIDE) * SPACING, 0.0f));
+    }
+    comp.mark_transforms_changed();
+
+    glm::vec3 center((SIDE - 1) * SPACING * 0.5f, (SIDE - 1) * SPACING * 0.5f, 0.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 50.0f);
+    const std::size_t ALL = std::numeric_limits <std::size_t>::max(), ANY = ALL - 1;
+    struct Camera
+    {
+        const char* name;
+        glm::mat4 view_projection;
+        /* Visible figures regardless of the corner test, ALL, 0 or ANY */
+        std::size_t visible;
+    };
+    const Camera cameras[] = {
+        { "clip space", glm::mat4(1), ANY },
+        { "whole grid", projection * glm::lookAt(center + glm::vec3(0.0f, 0.0f, 10.0f), center, glm::vec3(0.0f, 1.0f, 0.0f)), ALL },
+        { "corner", projection * glm::lookAt(glm::vec3(0.0f, 0.0f, 1.5f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), ANY },
+        { "grazing", projection * glm::lookAt(center + glm::vec3(0.0f, -6.0f, 1.0f), center, glm::vec3(0.0f, 0.0f, 1.0f)), ANY },
+        { "away", projection * glm::lookAt(center + glm::vec3(0.0f, 0.0f, 10.0f), center + glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(0.0f, 1.0f, 0.0f)), 0 }
+    };
+
+    unsigned int failures = 0;
+    for (double elapsed : { 0.0, 1.5 })
+    {
+        /* The second round refits the hierarchy to rotated figures */
+        transforms.update(elapsed);
+        comp.mark_transforms_changed();
+        for (const auto& camera : cameras)
+        {
+            comp.set_view_projection(camera.view_projection);
+            std::vector <unsigned int> culled = comp.cull();
+            std::sort(culled.begin(), culled.end());
+
+            std::vector <unsigned int> expected;
+            for (std::size_t i = 0; i < comp.get_figure_count(); ++i)
+            {
+                Bounds box = comp.get_figure(i).get_bounds().transformed(transforms.get_world(comp.get_transform_id(i)));
+                if (!outside_clip_space(box, camera.view_projection)) { expected.push_back(static_cast <unsigned int>(i)); }
+            }
+            std::size_t known = camera.visible == ALL ? comp.get_figure_count() : camera.visible;
+            bool passed = culled == expected && (known == ANY || culled.size() == known);
+            failures += !passed;
+            std::cout << "[SelfTest]: culling, " << camera.name << " at " << elapsed << " s: " << culled.size() << " of " << comp.get_figure_count() 
+                << " visible, " << expected.size() << " expected" << (passed ? "" : ", FAILED") << std::endl;
+        }
+    }
+    return failures;
+}
+
+/* The instanced board and the same pawns drawn one by one (see SceneConfig::board_layout) cover the same figures,
+   draw the same triangles and produce the same image */
+unsigned int check_instancing(const ShaderProgramInfo& source)
+{
+    SceneConfig per_object = { 16, 8, false, 1 };
+    per_object.board_layout = true;
+    per_object.keep_pixels = true;
+    SceneConfig instanced = per_object;
+    instanced.instanced = true;
+    FrameStats expected = render_offscreen(source, per_object);
+    FrameStats actual = render_offscreen(source, instanced);
+
+    unsigned long long visible = 0;
+    for (unsigned int level = 0; level < LOD_LEVELS; ++level) { visible += expected.lods.objects[level]; }
+    std::size_t differing = 0;
+    for (std::size_t i = 0; i + 3 < expected.pixels.size() && i + 3 < actual.pixels.size(); i += 4)
+    {
+        differing += !std::equal(expected.pixels.begin() + i, expected.pixels.begin() + i + 4, actual.pixels.begin() + i);
+    }
+    bool passed = visible == per_object.pawns * 5ull && expected.lods.objects[0] == visible && actual.triangles == expected.triangles 
+        && !actual.pixels.empty() && actual.pixels.size() == expected.pixels.size() && differing == 0;
+    std::cout << "[SelfTest]: instancing: " << visible << " of " << per_object.pawns * 5 << " figures visible, " << expected.triangles 
+        << " triangles per object, " << actual.triangles << " instanced, " << differing << " pixels differ" << (passed ? "" : ", FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
+
+/* Checks of the renderer, prints one line per check and returns how many failed */
+unsigned int run_self_test(const ShaderProgramInfo& source, unsigned int frames)
+{
+    unsigned int failures = check_generators();
+    failures += check_culling();
+    failures += check_instancing(source);
+    failures += check_allocations(source, frames);
+    if (failures == 0) { std::cout << "[SelfTest]: All checks passed" << std::endl; }
+    else { std::cout << "[SelfTest]: " << failures << " checks failed" << std::endl; }
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--bench-tessellation")
+        {
+            run_tessellation_benchmark();
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-colors")
+        {
+            run_color_benchmark();
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-import")
+        {
+            run_import_benchmark();
+            return 0;
+        }
+    }
+
+    /* --pawns N draws a board of N instanced pawns instead of the single pawn.
+       --headless renders --frames frames of the same scene offscreen and prints a JSON frame report,
+       --benchmark runs the headless scene suite and writes its JSON to stdout or --output,
+       --bench-startup compares generating meshes against loading them from the mesh cache directory,
+       which --no-mesh-cache disables, --bench-construction compares serial against SceneLoader construction.
+       --no-shader-cache always compiles the shader instead of loading the program binary kept from the last run.
+       --threads N records the non-instanced scene's draws on N threads.
+       --bench-overdraw measures fragments shaded per pixel offscreen with and without culling, sorting and a depth pre-pass.
+       --self-test runs the built-in checks, rendering --frames frames where they draw, and exits non-zero if any fails.
+       Builds with PAWN_PROFILE print per-scope frame time percentiles on exit and --profile-trace writes a Chrome trace */
+    unsigned int pawns = 0, frames = 300, threads = 0;
+    bool headless = false, benchmark = false, startup_benchmark = false, construction_benchmark = false, mesh_cache = true;
+    bool shader_cache = true, overdraw_benchmark = false, self_test = false;
+    std::string output;
+#ifdef PAWN_PROFILE
+    std::string profile_trace;
+    /* Written however main returns */
+    struct ProfileOutput
+    {
+        const std::string& trace;
+        ~ProfileOutput()
+        {
+            Profiler::instance().write_report(std::cout);
+            if (trace.empty()) { return; }
+            std::ofstream file(trace);
+            Profiler::instance().write_chrome_trace(file);
+            std::cout << "[Profile]: Chrome trace written to " << trace << std::endl;
+        }
+    } profile_output{ profile_trace };
+#endif
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--headless") { headless = true; }
+        if (arg == "--benchmark") { benchmark = true; }
+        if (arg == "--bench-startup") { startup_benchmark = true; }
+        if (arg == "--bench-construction") { construction_benchmark = true; }
+        if (arg == "--no-mesh-cache") { mesh_cache = false; }
+        if (arg == "--no-shader-cache") { shader_cache = false; }
+        if (arg == "--bench-overdraw") { overdraw_benchmark = true; }
+        if (arg == "--self-test") { self_test = true; }
+        if (i + 1 >= argc) { continue; }
+        if (arg == "--pawns") { pawns = static_cast <unsigned int>(std::stoul(argv[i + 1])); }
+        if (arg == "--frames") { frames = static_cast <unsigned int>(std::stoul(argv[i + 1])); }
+        if (arg == "--threads") { threads = static_cast <unsigned int>(std::stoul(argv[i + 1])); }
+        if (arg == "--output") { output = argv[i + 1]; }
+#ifdef PAWN_PROFILE
+        if (arg == "--profile-trace") { profile_trace = argv[i + 1]; }
+#endif
+    }
+
+    GLFWwindow* window = create_context(headless || benchmark || startup_benchmark || construction_benchmark || overdraw_benchmark || self_test);
+    if (!window)
     {
-        std::cout << "[GLEW]: Initialization Error!\n";
         return -1;
     }
-    std::cout << glGetString(GL_VERSION) << std::endl;
+    if (self_test)
+    {
+        unsigned int failures = run_self_test(parseShader(shader_path(argv, "/pawn.shader")), frames);
+        glfwTerminate();
+        return failures == 0 ? 0 : 1;
+    }
+    if (mesh_cache) { MeshCache::instance().set_directory(shader_path(argv, "/mesh_cache")); }
+    if (shader_cache) { ShaderManager::instance().set_directory(shader_path(argv, "/shader_cache")); }
+
+    if (startup_benchmark || construction_benchmark)
+    {
+        if (startup_benchmark) { run_startup_benchmark(std::cout); }
+        if (construction_benchmark) { run_construction_benchmark(std::cout); }
+        glfwTerminate();
+        return 0;
+    }
+    if (headless || benchmark || overdraw_benchmark)
+    {
+        ShaderProgramInfo source = parseShader(shader_path(argv, "/pawn.shader"));
+        std::ofstream file;
+        if (!output.empty()) { file.open(output); }
+        std::ostream& out = output.empty() ? std::cout : file;
+        if (benchmark)
+        {
+            run_frame_benchmark(source, frames, out);
+        }
+        else if (overdraw_benchmark)
+        {
+            run_overdraw_benchmark(source, frames, out);
+        }
+        else
+        {
+            SceneConfig config = { std::max(pawns, 1u), 20, pawns != 0, frames };
+            config.threads = threads;
+            print_frame_report(out, "headless", config, render_offscreen(source, config));
+            out << std::endl;
+        }
+        glfwTerminate();
+        return 0;
+    }
 
     glEnable(GL_DEPTH_TEST);
 
+    std::unique_ptr <WorkStealingPool> pool;
+    if (threads > 0) { pool = std::make_unique <WorkStealingPool>(threads); }
     Composition comp;
-    comp.add(new Sphere(0.0f, 0.5f, 0.0f, 0.2f, 20, 20, { 0.5f, 0.5f, 0.5f }, NULL_FLOAT_VECTOR));
-    comp.add(new StandingCylinder(0.0f, 0.05f, 0.0f, 0.1f, 0.4f, 20, 20, { 0.5f, 0.5f, 0.5f }, NULL_FLOAT_VECTOR));
-    comp.add(new StandingCylinder(0.0f, 0.25f, 0.0f, 0.2f, 0.05f, 20, 20, { 0.5f, 0.5f, 0.5f }, NULL_FLOAT_VECTOR));
-    comp.add(new StandingCylinder(0.0f, -0.35f, 0.0f, 0.15f, 0.4f, 20, 20, { 0.5f, 0.5f, 0.5f }, NULL_FLOAT_VECTOR));
-    comp.add(new StandingCylinder(0.0f, -0.5f, 0.0f, 0.25f, 0.2f, 20, 20, { 0.5f, 0.5f, 0.5f }, NULL_FLOAT_VECTOR));
+    comp.set_recording_pool(pool.get());
+    InstancedComposition board;
+    if (pawns == 0) { add_pawn(comp); }
+    else
+    {
+        add_pawn(board);
+        add_pawn_board(board, pawns);
+    }
+    MeshCacheStats cache_stats = MeshCache::instance().get_stats();
+    std::cout << "[MeshCache]: " << cache_stats.hits << " hits, " << cache_stats.misses << " misses, " 
+        << cache_stats.bytes_saved << " bytes saved, " << cache_stats.file_hits << " loaded from and " 
+        << cache_stats.file_writes << " written to disk" << std::endl;
+    std::size_t figure_count = pawns == 0 ? comp.get_figure_count() : board.get_mesh_count();
+    std::size_t color_bytes_saved = pawns == 0 ? comp.get_color_bytes_saved() : board.get_color_bytes_saved();
+    std::cout << "[Material]: " << color_bytes_saved << " bytes of vertex colors saved, " << color_bytes_saved / std::max <std::size_t>(figure_count, 1) 
+        << " per object" << std::endl;
+    /* The pawn never changes after upload, keep only the GPU copy */
+    comp.release_cpu_copies();
+    board.release_cpu_copies();
+    /* The five parts of the pawn share one transform and become a single draw */
+    comp.bake();
 
-    std::string path_shader = shader_path(argv, "/pawn.shader");
-    ShaderProgramInfo source = parseShader(path_shader);
-    unsigned int shader = createShader(source.vertexShaderProgramInfo, source.fragmentShaderProgramInfo);
+    /* Saving pawn.shader while running rebuilds the program, see ShaderManager::poll() */
+    std::shared_ptr <ShaderProgram> shader = ShaderManager::instance().load(shader_path(argv, "/pawn.shader"));
 
 
-    comp.init_rotation(shader);
+    comp.init_rotation(*shader);
+    board.init_rotation(*shader);
+    init_instance_attribute_defaults();
 
-    glUseProgram(shader);
+    shader->use();
 
+    double stats_time = glfwGetTime();
+    unsigned long long stats_calls = 0, stats_frames = 0;
+    char title[128];
     while (!glfwWindowShouldClose(window))
     {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        PAWN_PROFILE_END_FRAME();
+        PAWN_CPU_SCOPE("frame");
+        GLState::reset_frame_stats();
+        if (ShaderManager::instance().poll())
+        {
+            comp.init_rotation(*shader);
+            board.init_rotation(*shader);
+            shader->use();
+        }
+
+        GL_COUNTED(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
-        glClearColor(1, 1, 1, 1);
+        GL_COUNTED(glClearColor(1, 1, 1, 1));
 
-        comp.draw_composition(shader);
-        comp.apply_rotation(shader);
+        double elapsed = glfwGetTime();
+        if (pawns == 0)
+        {
+            comp.apply_rotation(elapsed);
+            comp.draw_composition(*shader);
+        }
+        else
+        {
+            board.apply_rotation(elapsed);
+            board.draw_composition(*shader);
+        }
+
+        stats_calls += GLState::get_calls();
+        ++stats_frames;
+        if (glfwGetTime() - stats_time >= 1.0)
+        {
+            std::snprintf(title, sizeof(title), "GLFW | %llu GL calls/frame", stats_calls / stats_frames);
+            glfwSetWindowTitle(window, title);
+            stats_time = glfwGetTime();
+            stats_calls = stats_frames = 0;
+        }
 
         glfwSwapBuffers(window);
 
         glfwPollEvents();
     }
 
-    glDeleteProgram(shader);
+    shader.reset();
     glfwTerminate();
 
 	return 0;
@@ -2,21 +2,33 @@
 
 #version 330 core
 
-in vec3 inPosition;
-in vec3 inColor;
-in vec3 inNormal;
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in mat4 instanceTransform;
+layout(location = 7) in vec3 instanceColor;
 
 out vec3 fragColor;
 out vec3 fragPos;
-
-uniform mat4 transform;
-
-//uniform mat4 modelViewProjection;
+out vec3 fragNormal;
+// The depth pre-pass program shares this stage and must produce bit-identical depth for GL_LEQUAL to pass
+invariant gl_Position;
+
+// World matrices of one composition, uploaded once per frame; transformIndex selects the object's
+layout(std140) uniform Transforms
+{
+    mat4 world[256];
+};
+uniform int transformIndex;
+uniform mat4 viewProjection;
 
 void main() {
-    gl_Position = transform * vec4(inPosition, 1.0);
+    mat4 model = world[transformIndex] * instanceTransform;
+    gl_Position = viewProjection * model * vec4(inPosition, 1.0);
     fragPos = inPosition;
-    fragColor = inColor;
+    // inColor is white for meshes without a color buffer
+    fragColor = inColor * instanceColor;
+    fragNormal = mat3(model) * inNormal;
 }
 
 #shader fragment
@@ -25,11 +37,23 @@ void main() {
 
 in vec3 fragColor;
 in vec3 fragPos;
+in vec3 fragNormal;
 
 out vec4 fragOutput;
 
-void main() {
-    float gradient = length(fragPos) / length(vec3(1.0));
+// Material of the drawn object: a solid color, darkened with the distance from the origin by materialGradient
+uniform vec3 materialColor;
+uniform float materialGradient;
 
-    fragOutput = vec4(fragColor * (1.0 - gradient), 1.0);
+const vec3 lightDirection = vec3(0.267, 0.802, 0.535);
+
+void main() {
+    float gradient = materialGradient * length(fragPos) / length(vec3(1.0));
+    // Meshes imported without normals stay unlit
+    float light = 1.0;
+    if (dot(fragNormal, fragNormal) > 0.0) {
+        light = 0.35 + 0.65 * max(dot(normalize(fragNormal), lightDirection), 0.0);
+    }
+
+    fragOutput = vec4(fragColor * materialColor * (1.0 - gradient) * light, 1.0);
 }
\ No newline at end of file